@@ -0,0 +1,285 @@
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "batchprocessor.h"
+#include "qrdetector.h"
+#include "qrutils.h"
+
+//////////////////////////////////////////////////////
+/// Constants definition section
+///
+static const char* DEFAULT_IMAGES = "tests/images";
+static const char* DEFAULT_REFERENCES = "tests/references";
+static const int DEFAULT_ITERATIONS = 3;
+//////////////////////////////////////////////////////
+
+namespace {
+
+    // An image of the corpus, being loaded once.
+    struct Sample {
+        cv::Mat image;
+        cv::Mat reference;
+    };
+
+    // Values of each parameter being swept.
+    struct Grid {
+        std::vector<double> cannyLower = {30, 50, 70};
+        std::vector<double> cannyUpper = {120, 180, 240};
+        std::vector<double> median = {3, 5};
+        std::vector<double> sampleThreshold = {127};
+        std::vector<double> epsilon = {1.0};
+        std::vector<double> maxArea = {5, 10, 20};
+    };
+
+    // Outcome of a single configuration.
+    struct Point {
+        QRDetector::Config config;
+        int detected;                // Images whose code has been found on the first pass, matching its reference if available.
+        double millisecondsPerImage; // Mean time of the timed passes.
+    };
+
+    /**
+     * Helper function, parsing a comma separated list of values.
+     * @param list the list
+     * @param values receives the values
+     * @return false, if the list is empty or malformed
+     */
+    bool parseList(const char* list, std::vector<double>& values) {
+        values.clear();
+        std::istringstream stream(list);
+        std::string item;
+        while(std::getline(stream, item, ',')) {
+            char* end;
+            values.push_back(std::strtod(item.c_str(), &end));
+            if(item.empty() || *end)
+                return false;
+        }
+        return !values.empty();
+    }
+
+    //! @brief Builds all valid combinations of the grid, preceded by the baseline configuration.
+    std::vector<QRDetector::Config> expandGrid(const Grid& grid, const QRDetector::Config& baseline) {
+        std::vector<QRDetector::Config> configs(1, baseline);
+        for(double lower : grid.cannyLower)
+        for(double upper : grid.cannyUpper)
+        for(double median : grid.median)
+        for(double threshold : grid.sampleThreshold)
+        for(double epsilon : grid.epsilon)
+        for(double maxArea : grid.maxArea) {
+            QRDetector::Config config = baseline;
+            config.cannyLowerThreshold = lower;
+            config.cannyUpperThreshold = upper;
+            config.medianBlurNeighbourhood = static_cast<int>(median);
+            config.binaryThreshold = static_cast<int>(threshold);
+            config.simplificationStartEpsilon = epsilon;
+            config.maxAreaThreshold = maxArea;
+            if(config.valid())
+                configs.push_back(config);
+        }
+        return configs;
+    }
+
+    /**
+     * Helper function, measuring a single configuration on the whole corpus. Codes need
+     * to be found on the first pass, without searching multiple scales.
+     * @param detector the detector, being configured
+     * @param samples the corpus
+     * @param iterations the number of timed passes
+     * @param point receives the outcome, its config being the one to measure
+     */
+    void measure(QRDetector& detector, const std::vector<Sample>& samples, int iterations, Point& point) {
+        detector.setConfig(point.config);
+        QRDetectorContext context;
+
+        // First pass, warming up and determining the detection rate.
+        point.detected = 0;
+        for(const Sample& sample : samples) {
+            cv::Mat code = detector.detectQRCode(sample.image, context);
+            cv::Mat diff;
+            if(!code.empty() && (sample.reference.empty() || compareWithReference(code, sample.reference, diff) == 0))
+                point.detected++;
+        }
+
+        // Timed passes.
+        int64 start = cv::getTickCount();
+        for(int it = 0; it < iterations; it++) {
+            for(const Sample& sample : samples)
+                detector.detectQRCode(sample.image, context);
+        }
+        double milliseconds = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+        point.millisecondsPerImage = milliseconds / (static_cast<double>(iterations) * samples.size());
+    }
+
+    /**
+     * Helper function, determining the configurations not being dominated by any other,
+     * i.e. no other one detects at least as many codes in less time.
+     * @param points the measured configurations
+     * @return the Pareto front, ordered by time
+     */
+    std::vector<Point> paretoFront(std::vector<Point> points) {
+        std::sort(points.begin(), points.end(), [](const Point& a, const Point& b) {
+            return a.millisecondsPerImage < b.millisecondsPerImage ||
+                   (a.millisecondsPerImage == b.millisecondsPerImage && a.detected > b.detected);
+        });
+
+        std::vector<Point> front;
+        for(const Point& point : points) {
+            if(front.empty() || point.detected > front.back().detected)
+                front.push_back(point);
+        }
+        return front;
+    }
+
+    //! @brief Prints the usage of the auto-tuner.
+    void printUsage() {
+        std::cout << "Usage: qr_autotune [-j <threads>] [-n <iterations>] [--json <output file>] [<image directory> [<reference directory>]]" << std::endl;
+        std::cout << "Grid:  --grid-canny-lower=<values> --grid-canny-upper=<values> --grid-median=<values>" << std::endl;
+        std::cout << "       --grid-sample-threshold=<values> --grid-epsilon=<values> --grid-max-area=<values>" << std::endl;
+        std::cout << "Options: --backend=contour|scanline --sampling=direct|warp --preprocessing=fused|opencv --binarization=otsu|sauvola|bradley --threads=<n> --prescreen=<min. runs>" << std::endl;
+        std::cout << "         --canny=<lower>,<upper> --median=<n> --sample-threshold=<t> --epsilon=<e> --max-area=<r> --adaptive=<radius>,<k> --prescreen-size=<px>" << std::endl;
+    }
+}
+
+/**
+ * Sweeps a grid of detector parameters over a corpus of images held in memory, values
+ * being given as comma separated lists. Each configuration is measured on its first
+ * pass, without searching multiple scales, such that the chosen one needs the fewest
+ * retries. Configurations are distributed over the threads, each one measuring a whole
+ * configuration at a time. Times are taken while all threads are busy, so they are
+ * meant to compare configurations rather than to predict the latency of a single one.
+ * Prints the Pareto front of detection rate versus time per image, each configuration
+ * being given as options of qr_detector and qr_benchmark.
+ */
+int main(int argc, char** argv) {
+
+    // Use the same configuration as the detector's release build.
+    QRDetector detector;
+    detector.setFusedPreprocessing(true);
+    detector.setDirectSampling(true);
+    if(!parseDetectorOptions(argc, argv, detector)) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    int iterations = DEFAULT_ITERATIONS;
+    int workers = std::max(1u, std::thread::hardware_concurrency());
+    std::string json;
+    Grid grid;
+    std::vector<std::string> directories;
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool valid = true;
+        if(arg == "-n" && i + 1 < argc) {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        } else if(arg == "-j" && i + 1 < argc) {
+            workers = std::max(1, std::atoi(argv[++i]));
+        } else if(arg == "--json" && i + 1 < argc) {
+            json = argv[++i];
+        } else if(arg.compare(0, 19, "--grid-canny-lower=") == 0) {
+            valid = parseList(arg.c_str() + 19, grid.cannyLower);
+        } else if(arg.compare(0, 19, "--grid-canny-upper=") == 0) {
+            valid = parseList(arg.c_str() + 19, grid.cannyUpper);
+        } else if(arg.compare(0, 14, "--grid-median=") == 0) {
+            valid = parseList(arg.c_str() + 14, grid.median);
+        } else if(arg.compare(0, 24, "--grid-sample-threshold=") == 0) {
+            valid = parseList(arg.c_str() + 24, grid.sampleThreshold);
+        } else if(arg.compare(0, 15, "--grid-epsilon=") == 0) {
+            valid = parseList(arg.c_str() + 15, grid.epsilon);
+        } else if(arg.compare(0, 16, "--grid-max-area=") == 0) {
+            valid = parseList(arg.c_str() + 16, grid.maxArea);
+        } else if(arg[0] != '-' && directories.size() < 2) {
+            directories.push_back(arg);
+        } else {
+            valid = false;
+        }
+        if(!valid) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+    std::string imageDir = (directories.size() > 0) ? directories[0] : DEFAULT_IMAGES;
+    std::string referenceDir = (directories.size() > 1) ? directories[1] : DEFAULT_REFERENCES;
+
+    // Load the corpus into memory once, being shared by all threads.
+    std::vector<Sample> samples;
+    for(const std::string& input : BatchProcessor::collectInputs(imageDir)) {
+        Sample sample;
+        sample.image = cv::imread(input);
+        if(sample.image.empty()) {
+            std::cout << "Failed to load " << input << std::endl;
+            continue;
+        }
+        sample.reference = cv::imread(referenceFile(input, referenceDir), cv::IMREAD_GRAYSCALE);
+        samples.push_back(sample);
+    }
+    if(samples.empty()) {
+        std::cout << "No input images found!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<QRDetector::Config> configs = expandGrid(grid, detector.config());
+    std::vector<Point> points(configs.size());
+    for(size_t i = 0; i < configs.size(); i++)
+        points[i].config = configs[i];
+    std::cout << "Measuring " << configs.size() << " configurations on " << samples.size() << " images..." << std::endl;
+
+    // We parallelize over configurations, so OpenCV should not spawn threads on its own.
+    int numThreads = cv::getNumThreads();
+    cv::setNumThreads(1);
+
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for(int t = 0; t < std::min(workers, static_cast<int>(configs.size())); t++) {
+        threads.emplace_back([&] {
+            QRDetector worker = detector;
+            for(size_t i = next++; i < points.size(); i = next++)
+                measure(worker, samples, iterations, points[i]);
+        });
+    }
+    for(std::thread& thread : threads)
+        thread.join();
+
+    cv::setNumThreads(numThreads);
+
+    // The first configuration is the baseline, given by the options or the defaults.
+    const double images = static_cast<double>(samples.size());
+    std::vector<Point> front = paretoFront(points);
+    std::cout << "# baseline: detection rate " << points[0].detected / images << ", " << points[0].millisecondsPerImage << " ms/image\n";
+    std::cout << "# pareto front (detection rate, ms/image, options):\n";
+    for(const Point& point : front)
+        std::cout << point.detected / images << "\t" << point.millisecondsPerImage << "\t" << formatDetectorConfig(point.config) << "\n";
+    std::cout << std::flush;
+
+    // Machine readable report.
+    if(!json.empty()) {
+        std::ofstream out(json.c_str());
+        out << "{\n";
+        out << "  \"images\": " << samples.size() << ",\n";
+        out << "  \"configurations\": " << configs.size() << ",\n";
+        out << "  \"iterations\": " << iterations << ",\n";
+        out << "  \"baseline\": {\"detection_rate\": " << points[0].detected / images << ", \"ms_per_image\": " << points[0].millisecondsPerImage << "},\n";
+        out << "  \"front\": [\n";
+        for(size_t i = 0; i < front.size(); i++) {
+            out << "    {\"detection_rate\": " << front[i].detected / images << ", \"ms_per_image\": " << front[i].millisecondsPerImage
+                << ", \"options\": " << quoteJson(formatDetectorConfig(front[i].config)) << "}"
+                << (i + 1 < front.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n";
+        out << "}\n";
+
+        if(!out) {
+            std::cout << "Failed to write " << json << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,246 @@
+#include "batchprocessor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <thread>
+
+#include <sys/stat.h>
+
+#include "boundedqueue.h"
+#include "qrdecoder.h"
+#include "qrutils.h"
+
+// Number of elements being buffered between two stages, per thread.
+static const int QUEUE_SIZE_PER_THREAD = 2;
+
+namespace {
+
+    // Image passed from the decoding to the detection stage.
+    struct DecodedImage {
+        size_t index;
+        cv::Mat image;
+        cv::Mat reference;
+    };
+
+    // Result passed from the detection to the encoding stage.
+    struct DetectedCode {
+        size_t index;
+        cv::Mat code;
+        cv::Mat diff;
+        QRDetector::QRCode location; // Corners of the code inside its image, if found.
+    };
+
+    //! @brief Checks whether the given file is an image, judging by its extension.
+    bool isImageFile(const std::string& path) {
+        size_t dot = path.rfind('.');
+        if(dot == std::string::npos)
+            return false;
+
+        std::string ext = path.substr(dot + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp";
+    }
+}
+
+BatchProcessor::Options::Options()
+    : workers(std::max(1u, std::thread::hardware_concurrency()))
+    , decoders(std::max(1u, std::thread::hardware_concurrency() / 2))
+    , tryScaling(true)
+    , compact(false)
+{
+}
+
+BatchProcessor::BatchProcessor(const Options& options)
+    : options_(options)
+{
+    options_.workers = std::max(1, options_.workers);
+    options_.decoders = std::max(1, options_.decoders);
+}
+
+std::vector<std::string> BatchProcessor::collectInputs(const std::string& input) {
+    std::vector<std::string> inputs;
+
+    struct stat info;
+    if(stat(input.c_str(), &info) != 0)
+        return inputs;
+
+    if(S_ISDIR(info.st_mode)) {
+        std::vector<cv::String> files;
+        cv::glob(input + "/*", files, false);
+        for(const cv::String& file : files) {
+            if(isImageFile(file))
+                inputs.push_back(file);
+        }
+    } else {
+        std::ifstream list(input.c_str());
+        std::string line;
+        while(std::getline(list, line)) {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if(!line.empty())
+                inputs.push_back(line);
+        }
+    }
+
+    return inputs;
+}
+
+std::vector<BatchProcessor::Result> BatchProcessor::process(const std::vector<std::string>& inputs, const std::string& outputDir, const std::string& referenceDir) const {
+    return process(inputs, outputDir, [&](size_t i, cv::Mat& image, cv::Mat& reference) {
+        image = cv::imread(inputs[i]);
+        if(!image.empty() && !referenceDir.empty())
+            reference = cv::imread(referenceFile(inputs[i], referenceDir), cv::IMREAD_GRAYSCALE);
+    });
+}
+
+std::vector<BatchProcessor::Result> BatchProcessor::process(const CorpusFile& corpus, const std::string& outputDir) const {
+    std::vector<std::string> names(corpus.size());
+    for(size_t i = 0; i < corpus.size(); i++)
+        names[i] = corpus.name(i);
+
+    // Frames are views into the mapped file, so there is nothing left to decode.
+    return process(names, outputDir, [&](size_t i, cv::Mat& image, cv::Mat& reference) {
+        image = corpus.image(i);
+        corpus.reference(i, reference);
+    });
+}
+
+std::vector<BatchProcessor::Result> BatchProcessor::process(const std::vector<std::string>& inputs, const std::string& outputDir, const Loader& load) const {
+    std::vector<Result> results(inputs.size());
+    for(size_t i = 0; i < inputs.size(); i++) {
+        results[i].input = inputs[i];
+        results[i].status = STATUS_LOAD_FAILED;
+        results[i].errors = 0;
+        results[i].milliseconds = 0.0;
+    }
+
+    mkdir(outputDir.c_str(), 0755);
+
+    // We parallelize over images, so OpenCV only provides the threads for tiling, if requested.
+    int numThreads = cv::getNumThreads();
+    cv::setNumThreads(options_.detector.threads());
+
+    BoundedQueue<DecodedImage> decoded(QUEUE_SIZE_PER_THREAD * options_.workers);
+    BoundedQueue<DetectedCode> detected(QUEUE_SIZE_PER_THREAD * options_.workers);
+
+    // Stage 1: Load the images.
+    std::atomic<size_t> next(0);
+    std::atomic<int> activeDecoders(options_.decoders);
+    std::vector<std::thread> decoders;
+    for(int t = 0; t < options_.decoders; t++) {
+        decoders.emplace_back([&] {
+            for(size_t i = next++; i < inputs.size(); i = next++) {
+                DecodedImage item;
+                item.index = i;
+                load(i, item.image, item.reference);
+                if(!decoded.push(std::move(item)))
+                    break;
+            }
+            if(--activeDecoders == 0)
+                decoded.close();
+        });
+    }
+
+    // Stage 2: Detect the codes, each worker owning its own detector and buffers.
+    std::atomic<int> activeWorkers(options_.workers);
+    std::vector<std::thread> workers;
+    for(int t = 0; t < options_.workers; t++) {
+        workers.emplace_back([&] {
+            QRDetector detector = options_.detector;
+            QRDetectorContext context;
+            QRDecoder decoder;
+            DecodedImage item;
+            while(decoded.pop(item)) {
+                Result& result = results[item.index];
+                DetectedCode code;
+                code.index = item.index;
+
+                if(!item.image.empty()) {
+                    int64 start = cv::getTickCount();
+                    // The code is handed over to the writer, so it may not share the context's buffers.
+                    code.code = detectWithScaling(detector, item.image, options_.tryScaling, context).clone();
+                    result.milliseconds = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+                    if(context.code())
+                        code.location = *context.code();
+
+                    if(!code.code.empty()) {
+                        QRDecoder::Result payload = decoder.decode(code.code);
+                        if(payload.status == QRDecoder::STATUS_OK)
+                            result.payload = payload.payload;
+                    }
+
+                    if(code.code.empty()) {
+                        result.status = STATUS_NOT_FOUND;
+                    } else if(item.reference.empty()) {
+                        result.status = STATUS_FOUND;
+                    } else {
+                        result.errors = compareWithReference(code.code, item.reference, code.diff);
+                        result.status = result.errors ? STATUS_PARTIAL : STATUS_CORRECT;
+                        if(!result.errors)
+                            code.diff.release();
+                    }
+                }
+
+                if(!detected.push(std::move(code)))
+                    break;
+            }
+            if(--activeWorkers == 0)
+                detected.close();
+        });
+    }
+
+    // Stage 3: Write the results.
+    std::thread encoder([&] {
+        DetectedCode item;
+        BitMatrix bits;
+        while(detected.pop(item)) {
+            if(results[item.index].status == STATUS_LOAD_FAILED)
+                continue;
+
+            // Codes not being found are written as empty record or single black pixel.
+            std::string stem = outputDir + "/" + fileStem(inputs[item.index]);
+            if(options_.compact) {
+                bits.fromMat(item.code);
+                writeCompact(stem + ".qrb", bits, item.code.empty() ? nullptr : &item.location);
+            } else {
+                writeUncompressed(stem + ".png", item.code.empty() ? cv::Mat(cv::Mat::zeros(1, 1, CV_8UC1)) : item.code);
+            }
+            if(!item.diff.empty())
+                writeUncompressed(stem + "_diff.png", item.diff);
+        }
+    });
+
+    for(std::thread& thread : decoders)
+        thread.join();
+    for(std::thread& thread : workers)
+        thread.join();
+    encoder.join();
+
+    cv::setNumThreads(numThreads);
+
+    return results;
+}
+
+void BatchProcessor::writeSummary(std::ostream& stream, const std::vector<Result>& results) {
+    static const char* names[] = {"correct", "partial", "found", "notfound", "loadfailed"};
+
+    int counts[5] = {0}, decoded = 0;
+    double total = 0.0;
+    for(const Result& result : results) {
+        std::string payload = result.payload;
+        std::replace_if(payload.begin(), payload.end(), [](char c) { return static_cast<unsigned char>(c) < 0x20; }, ' ');
+
+        stream << result.input << "\t" << names[result.status] << "\t" << result.errors << "\t" << result.milliseconds << "\t" << payload << "\n";
+        counts[result.status]++;
+        total += result.milliseconds;
+        if(!result.payload.empty())
+            decoded++;
+    }
+
+    stream << "# images: " << results.size() << "\n";
+    for(int i = 0; i < 5; i++)
+        stream << "# " << names[i] << ": " << counts[i] << "\n";
+    stream << "# decoded: " << decoded << "\n";
+    if(!results.empty())
+        stream << "# mean detection time [ms]: " << total / results.size() << "\n";
+}
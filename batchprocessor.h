@@ -0,0 +1,95 @@
+#ifndef QR_CODE_BATCHPROCESSOR_H
+#define QR_CODE_BATCHPROCESSOR_H
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "corpusfile.h"
+#include "qrdetector.h"
+
+/**
+ * Runs the QR detector over a whole set of images within a single process.
+ * Decoding, detection and encoding of the results are distributed over
+ * separate stages, connected by bounded queues, such that a fixed pool of
+ * detection threads is kept busy all the time.
+ */
+class BatchProcessor {
+public:
+
+    // Outcome of a single image.
+    enum Status {
+        STATUS_CORRECT,     // Code found and matches its reference.
+        STATUS_PARTIAL,     // Code found, but differs from its reference.
+        STATUS_FOUND,       // Code found, no reference available.
+        STATUS_NOT_FOUND,   // No code found.
+        STATUS_LOAD_FAILED, // Image could not be loaded.
+    };
+
+    struct Options {
+        int workers;     // Number of detection threads.
+        int decoders;    // Number of image decoding threads.
+        bool tryScaling; // Retry on a rescaled image, in case no code has been found.
+        bool compact;    // Write the codes as bit-packed records <stem>.qrb, instead of PNG images.
+        QRDetector detector; // Configured detector, being copied for each thread.
+        Options();
+    };
+
+    struct Result {
+        std::string input;
+        Status status;
+        int errors;          // Differing modules, or -1 if sizes do not match.
+        double milliseconds; // Time spent for detection.
+        std::string payload; // Decoded content of the code, empty if not decodable.
+    };
+
+    explicit BatchProcessor(const Options& options = Options());
+
+    /**
+     * Collects the images to be processed.
+     * @param input either a directory holding images or a text file listing one image per line
+     * @return the list of image files
+     */
+    static std::vector<std::string> collectInputs(const std::string& input);
+
+    /**
+     * Processes each image and writes the normalized code into the output directory,
+     * either as <stem>.png or as compact record <stem>.qrb.
+     * If a reference directory is given, each result is compared with the reference
+     * <name>.png, where the image file is named <name>_<suffix>.<ext>.
+     * Mismatches will additionally be written as <stem>_diff.png.
+     * @param inputs the image files
+     * @param outputDir the directory receiving the results
+     * @param referenceDir optional directory holding the references
+     * @return the results, in the order of the input files
+     */
+    std::vector<Result> process(const std::vector<std::string>& inputs, const std::string& outputDir, const std::string& referenceDir = "") const;
+
+    /**
+     * Same as above, but processes the frames of a corpus file without decoding them,
+     * each one being compared with its reference if the corpus holds one.
+     * @param corpus the opened corpus, results being named after its frames
+     * @param outputDir the directory receiving the results
+     * @return the results, in the order of the frames
+     */
+    std::vector<Result> process(const CorpusFile& corpus, const std::string& outputDir) const;
+
+    //! @brief Writes one line per image followed by the overall statistics, control characters of payloads being replaced by spaces.
+    static void writeSummary(std::ostream& stream, const std::vector<Result>& results);
+
+private:
+
+    // Loads the image with the given index and its reference, leaving the reference empty if not available.
+    typedef std::function<void(size_t, cv::Mat&, cv::Mat&)> Loader;
+
+    //! @brief Implements process, images being loaded by the decoding threads.
+    std::vector<Result> process(const std::vector<std::string>& inputs, const std::string& outputDir, const Loader& load) const;
+
+    Options options_;
+};
+
+
+#endif //QR_CODE_BATCHPROCESSOR_H
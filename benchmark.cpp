@@ -0,0 +1,247 @@
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include "batchprocessor.h"
+#include "corpusfile.h"
+#include "qrdetector.h"
+#include "qrutils.h"
+
+//////////////////////////////////////////////////////
+/// Constants definition section
+///
+static const char* DEFAULT_IMAGES = "tests/images";
+static const char* DEFAULT_REFERENCES = "tests/references";
+static const int DEFAULT_ITERATIONS = 10;
+//////////////////////////////////////////////////////
+
+namespace {
+
+    // An image of the corpus, being loaded once.
+    struct Sample {
+        std::string input;
+        cv::Mat image;
+        cv::Mat reference;
+    };
+
+    // Names of the outcomes, in order of BatchProcessor::Status.
+    const char* STATUS_NAMES[] = {"correct", "partial", "found", "notfound", "loadfailed"};
+
+    /**
+     * Helper function, determining a percentile by the nearest rank method.
+     * @param sorted the values in ascending order
+     * @param p the percentile, between 0 and 100
+     * @return the percentile, or 0 if there are no values
+     */
+    double percentile(const std::vector<double>& sorted, double p) {
+        if(sorted.empty())
+            return 0.0;
+
+        size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+        return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+    }
+
+    //! @brief Prints the usage of the benchmark.
+    void printUsage() {
+        std::cout << "Usage: qr_benchmark [-n <iterations>] [--no-scaling] [--json <output file>] [<image directory> [<reference directory>] | <corpus file>]" << std::endl;
+        std::cout << "Options: --backend=contour|scanline --sampling=direct|warp --preprocessing=fused|opencv --binarization=otsu|sauvola|bradley --threads=<n> --prescreen=<min. runs>" << std::endl;
+        std::cout << "         --canny=<lower>,<upper> --median=<n> --sample-threshold=<t> --epsilon=<e> --max-area=<r> --adaptive=<radius>,<k> --prescreen-size=<px>" << std::endl;
+    }
+}
+
+/**
+ * Measures the detector on a corpus of images held in memory. Each image is processed
+ * once to warm up the buffers and to determine the accuracy against its reference.
+ * Afterwards, the whole corpus is processed the given number of times while measuring
+ * the latency of each image and the time spent in each stage of the detector.
+ */
+int main(int argc, char** argv) {
+
+    // Use the same configuration as the detector's release build.
+    QRDetector detector;
+    detector.setFusedPreprocessing(true);
+    detector.setDirectSampling(true);
+    if(!parseDetectorOptions(argc, argv, detector)) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    int iterations = DEFAULT_ITERATIONS;
+    bool tryScaling = true;
+    std::string json;
+    std::vector<std::string> directories;
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if(arg == "-n" && i + 1 < argc) {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        } else if(arg == "--no-scaling") {
+            tryScaling = false;
+        } else if(arg == "--json" && i + 1 < argc) {
+            json = argv[++i];
+        } else if(arg[0] != '-' && directories.size() < 2) {
+            directories.push_back(arg);
+        } else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+    std::string imageDir = (directories.size() > 0) ? directories[0] : DEFAULT_IMAGES;
+    std::string referenceDir = (directories.size() > 1) ? directories[1] : DEFAULT_REFERENCES;
+
+    // Load the corpus into memory once, such that only the detection is measured.
+    // Frames of a corpus file are views into its mapping, which stays open for the run.
+    std::vector<Sample> samples;
+    CorpusFile corpus;
+    if(CorpusFile::isCorpusFile(imageDir)) {
+        if(!corpus.open(imageDir)) {
+            std::cout << "Failed to open corpus " << imageDir << std::endl;
+            return EXIT_FAILURE;
+        }
+        samples.resize(corpus.size());
+        for(size_t i = 0; i < corpus.size(); i++) {
+            samples[i].input = corpus.name(i);
+            samples[i].image = corpus.image(i);
+            corpus.reference(i, samples[i].reference);
+        }
+    } else {
+        for(const std::string& input : BatchProcessor::collectInputs(imageDir)) {
+            Sample sample;
+            sample.input = input;
+            sample.image = cv::imread(input);
+            if(sample.image.empty()) {
+                std::cout << "Failed to load " << input << std::endl;
+                continue;
+            }
+            sample.reference = cv::imread(referenceFile(input, referenceDir), cv::IMREAD_GRAYSCALE);
+            samples.push_back(sample);
+        }
+    }
+    if(samples.empty()) {
+        std::cout << "No input images found!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    QRDetectorContext context;
+    QRDetector::Stats stats;
+
+    // First pass, warming up and determining the accuracy. Modules of codes
+    // not matching their reference in size all count as bit errors.
+    std::vector<BatchProcessor::Result> results(samples.size());
+    std::vector<QRDetector::Stats> sampleStats(samples.size());
+    long long bits = 0, bitErrors = 0;
+    for(size_t i = 0; i < samples.size(); i++) {
+        BatchProcessor::Result& result = results[i];
+        result.input = samples[i].input;
+        result.errors = 0;
+
+        context.setStats(&sampleStats[i]);
+        cv::Mat code = detectWithScaling(detector, samples[i].image, tryScaling, context);
+        if(code.empty()) {
+            result.status = BatchProcessor::STATUS_NOT_FOUND;
+        } else if(samples[i].reference.empty()) {
+            result.status = BatchProcessor::STATUS_FOUND;
+        } else {
+            cv::Mat diff;
+            const int modules = static_cast<int>(samples[i].reference.total());
+            result.errors = compareWithReference(code, samples[i].reference, diff);
+            result.status = result.errors ? BatchProcessor::STATUS_PARTIAL : BatchProcessor::STATUS_CORRECT;
+            bits += modules;
+            bitErrors += (result.errors < 0) ? modules : result.errors;
+        }
+    }
+
+    // Timed passes.
+    context.setStats(&stats);
+    std::vector<std::vector<double>> latencies(samples.size());
+    std::vector<double> allLatencies;
+    int64 start = cv::getTickCount();
+    for(int it = 0; it < iterations; it++) {
+        for(size_t i = 0; i < samples.size(); i++) {
+            int64 begin = cv::getTickCount();
+            detectWithScaling(detector, samples[i].image, tryScaling, context);
+            double milliseconds = (cv::getTickCount() - begin) * 1000.0 / cv::getTickFrequency();
+
+            latencies[i].push_back(milliseconds);
+            allLatencies.push_back(milliseconds);
+        }
+    }
+    double seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+    const double runs = static_cast<double>(allLatencies.size());
+
+    // Evaluate the measurements.
+    for(size_t i = 0; i < samples.size(); i++) {
+        std::sort(latencies[i].begin(), latencies[i].end());
+        results[i].milliseconds = percentile(latencies[i], 50);
+    }
+    std::sort(allLatencies.begin(), allLatencies.end());
+    double mean = 0.0;
+    for(double latency : allLatencies)
+        mean += latency;
+    mean /= runs;
+    const double throughput = runs / seconds;
+    const double bitErrorRate = bits ? static_cast<double>(bitErrors) / bits : 0.0;
+
+    // Each image of the corpus holds a code, so any image rejected by the prescreen lowers its recall.
+    int counts[5] = {0}, rejected = 0;
+    for(size_t i = 0; i < results.size(); i++) {
+        counts[results[i].status]++;
+        if(sampleStats[i].failure == QRDetector::FAILURE_PRESCREEN)
+            rejected++;
+    }
+    const double prescreenRecall = 1.0 - static_cast<double>(rejected) / samples.size();
+
+    // Human readable report, including the median latency per image.
+    BatchProcessor::writeSummary(std::cout, results);
+    std::cout << "# iterations: " << iterations << "\n";
+    std::cout << "# throughput [images/s]: " << throughput << "\n";
+    std::cout << "# latency [ms]: mean " << mean << ", p50 " << percentile(allLatencies, 50)
+              << ", p90 " << percentile(allLatencies, 90) << ", p99 " << percentile(allLatencies, 99)
+              << ", max " << allLatencies.back() << "\n";
+    for(int s = 0; s < QRDetector::STAGE_COUNT; s++)
+        std::cout << "# stage " << QRDetector::Stats::stageName(static_cast<QRDetector::Stage>(s)) << " [ms/image]: " << stats.milliseconds[s] / runs << "\n";
+    std::cout << "# contours/image: " << stats.contours / runs << ", markers/image: " << stats.markers / runs
+              << ", simplify iterations/image: " << stats.simplifyIterations / runs << "\n";
+    std::cout << "# prescreen recall: " << prescreenRecall << " (" << samples.size() - rejected << "/" << samples.size() << ")\n";
+    std::cout << "# bit error rate: " << bitErrorRate << " (" << bitErrors << "/" << bits << ")" << std::endl;
+
+    // Machine readable report, to be compared between commits.
+    if(!json.empty()) {
+        std::ofstream out(json.c_str());
+        out << "{\n";
+        out << "  \"images\": " << samples.size() << ",\n";
+        out << "  \"iterations\": " << iterations << ",\n";
+        out << "  \"throughput\": " << throughput << ",\n";
+        out << "  \"latency_ms\": {\"mean\": " << mean << ", \"p50\": " << percentile(allLatencies, 50)
+            << ", \"p90\": " << percentile(allLatencies, 90) << ", \"p99\": " << percentile(allLatencies, 99)
+            << ", \"max\": " << allLatencies.back() << "},\n";
+        out << "  \"stages_ms\": {";
+        for(int s = 0; s < QRDetector::STAGE_COUNT; s++)
+            out << (s ? ", " : "") << quoteJson(QRDetector::Stats::stageName(static_cast<QRDetector::Stage>(s))) << ": " << stats.milliseconds[s] / runs;
+        out << "},\n";
+        out << "  \"counters\": {\"contours\": " << stats.contours / runs << ", \"markers\": " << stats.markers / runs
+            << ", \"simplify_iterations\": " << stats.simplifyIterations / runs << ", \"codes\": " << stats.codes / runs << "},\n";
+        out << "  \"accuracy\": {";
+        for(int s = 0; s < 5; s++)
+            out << quoteJson(STATUS_NAMES[s]) << ": " << counts[s] << ", ";
+        out << "\"prescreen_rejected\": " << rejected << ", \"prescreen_recall\": " << prescreenRecall << ", ";
+        out << "\"bit_errors\": " << bitErrors << ", \"bits\": " << bits << ", \"bit_error_rate\": " << bitErrorRate << "},\n";
+        out << "  \"results\": [\n";
+        for(size_t i = 0; i < results.size(); i++) {
+            out << "    {\"input\": " << quoteJson(results[i].input) << ", \"status\": " << quoteJson(STATUS_NAMES[results[i].status])
+                << ", \"errors\": " << results[i].errors << ", \"p50_ms\": " << results[i].milliseconds
+                << ", \"scale\": " << sampleStats[i].scale << ", \"failure\": " << quoteJson(QRDetector::Stats::failureName(sampleStats[i].failure)) << "}"
+                << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n";
+        out << "}\n";
+
+        if(!out) {
+            std::cout << "Failed to write " << json << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
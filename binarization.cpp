@@ -0,0 +1,372 @@
+#include "binarization.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define QR_USE_NEON
+#endif
+
+// Fixed point grayscale conversion, matching cv::cvtColor with CV_RGB2GRAY.
+static const int GRAY_SHIFT = 14;
+static const int GRAY_COEFF_0 = 4899; // R2Y, applied to the first channel.
+static const int GRAY_COEFF_1 = 9617; // G2Y
+static const int GRAY_COEFF_2 = 1868; // B2Y, applied to the third channel.
+
+namespace {
+
+    // Scalar operations, processing a single pixel at a time.
+    struct ScalarOps {
+        typedef uchar Vec;
+        static const int WIDTH = 1;
+        static Vec load(const uchar* p) { return *p; }
+        static void store(uchar* p, Vec v) { *p = v; }
+        static Vec min(Vec a, Vec b) { return a < b ? a : b; }
+        static Vec max(Vec a, Vec b) { return a < b ? b : a; }
+    };
+
+#if defined(__AVX2__)
+    // AVX2 operations, processing 32 pixels at a time.
+    struct VectorOps {
+        typedef __m256i Vec;
+        static const int WIDTH = 32;
+        static Vec load(const uchar* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+        static void store(uchar* p, Vec v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+        static Vec min(Vec a, Vec b) { return _mm256_min_epu8(a, b); }
+        static Vec max(Vec a, Vec b) { return _mm256_max_epu8(a, b); }
+        static Vec greater(Vec a, uchar t) {
+            // a > t <=> max(a, t + 1) == a, the caller guarantees t < 255.
+            return _mm256_cmpeq_epi8(_mm256_max_epu8(a, _mm256_set1_epi8(static_cast<char>(t + 1))), a);
+        }
+    };
+#define QR_HAVE_VECTOR_OPS
+#elif defined(QR_USE_NEON)
+    // NEON operations, processing 16 pixels at a time.
+    struct VectorOps {
+        typedef uint8x16_t Vec;
+        static const int WIDTH = 16;
+        static Vec load(const uchar* p) { return vld1q_u8(p); }
+        static void store(uchar* p, Vec v) { vst1q_u8(p, v); }
+        static Vec min(Vec a, Vec b) { return vminq_u8(a, b); }
+        static Vec max(Vec a, Vec b) { return vmaxq_u8(a, b); }
+        static Vec greater(Vec a, uchar t) { return vcgtq_u8(a, vdupq_n_u8(t)); }
+    };
+#define QR_HAVE_VECTOR_OPS
+#endif
+
+    //! @brief Sorts two values, such that a <= b.
+    template<typename Ops>
+    inline void sort(typename Ops::Vec& a, typename Ops::Vec& b) {
+        typename Ops::Vec t = Ops::min(a, b);
+        b = Ops::max(a, b);
+        a = t;
+    }
+
+    /**
+     * Applies a 3x3 median filter onto a row, using the sorting network of cv::medianBlur.
+     * The input rows are padded by a single pixel on both sides.
+     * @return the number of pixels being processed
+     */
+    template<typename Ops>
+    int medianRow(const uchar* r0, const uchar* r1, const uchar* r2, uchar* dst, int begin, int end) {
+        typedef typename Ops::Vec Vec;
+        int x = begin;
+        for(; x + Ops::WIDTH <= end; x += Ops::WIDTH) {
+            Vec p0 = Ops::load(r0 + x), p1 = Ops::load(r0 + x + 1), p2 = Ops::load(r0 + x + 2);
+            Vec p3 = Ops::load(r1 + x), p4 = Ops::load(r1 + x + 1), p5 = Ops::load(r1 + x + 2);
+            Vec p6 = Ops::load(r2 + x), p7 = Ops::load(r2 + x + 1), p8 = Ops::load(r2 + x + 2);
+
+            sort<Ops>(p1, p2); sort<Ops>(p4, p5); sort<Ops>(p7, p8); sort<Ops>(p0, p1);
+            sort<Ops>(p3, p4); sort<Ops>(p6, p7); sort<Ops>(p1, p2); sort<Ops>(p4, p5);
+            sort<Ops>(p7, p8); sort<Ops>(p0, p3); sort<Ops>(p5, p8); sort<Ops>(p4, p7);
+            sort<Ops>(p3, p6); sort<Ops>(p1, p4); sort<Ops>(p2, p5); sort<Ops>(p4, p7);
+            sort<Ops>(p4, p2); sort<Ops>(p6, p4); sort<Ops>(p4, p2);
+
+            Ops::store(dst + x, p4);
+        }
+        return x;
+    }
+
+    //! @brief Median filters a whole row, vectorized where possible.
+    void medianRow(const uchar* r0, const uchar* r1, const uchar* r2, uchar* dst, int width) {
+        int x = 0;
+#ifdef QR_HAVE_VECTOR_OPS
+        x = medianRow<VectorOps>(r0, r1, r2, dst, x, width);
+#endif
+        medianRow<ScalarOps>(r0, r1, r2, dst, x, width);
+    }
+
+    //! @brief Converts a row into grayscale, writing it into a padded buffer.
+    void grayRow(const uchar* src, uchar* dst, int width) {
+        int x = 0;
+#ifdef QR_USE_NEON
+        const uint32x4_t round = vdupq_n_u32(1u << (GRAY_SHIFT - 1));
+        for(; x + 16 <= width; x += 16) {
+            uint8x16x3_t px = vld3q_u8(src + 3 * x);
+            uint16x8_t c0l = vmovl_u8(vget_low_u8(px.val[0])), c0h = vmovl_u8(vget_high_u8(px.val[0]));
+            uint16x8_t c1l = vmovl_u8(vget_low_u8(px.val[1])), c1h = vmovl_u8(vget_high_u8(px.val[1]));
+            uint16x8_t c2l = vmovl_u8(vget_low_u8(px.val[2])), c2h = vmovl_u8(vget_high_u8(px.val[2]));
+
+            uint32x4_t a0 = vmlal_n_u16(vmlal_n_u16(vmlal_n_u16(round, vget_low_u16(c0l), GRAY_COEFF_0), vget_low_u16(c1l), GRAY_COEFF_1), vget_low_u16(c2l), GRAY_COEFF_2);
+            uint32x4_t a1 = vmlal_n_u16(vmlal_n_u16(vmlal_n_u16(round, vget_high_u16(c0l), GRAY_COEFF_0), vget_high_u16(c1l), GRAY_COEFF_1), vget_high_u16(c2l), GRAY_COEFF_2);
+            uint32x4_t a2 = vmlal_n_u16(vmlal_n_u16(vmlal_n_u16(round, vget_low_u16(c0h), GRAY_COEFF_0), vget_low_u16(c1h), GRAY_COEFF_1), vget_low_u16(c2h), GRAY_COEFF_2);
+            uint32x4_t a3 = vmlal_n_u16(vmlal_n_u16(vmlal_n_u16(round, vget_high_u16(c0h), GRAY_COEFF_0), vget_high_u16(c1h), GRAY_COEFF_1), vget_high_u16(c2h), GRAY_COEFF_2);
+
+            uint16x8_t lo = vcombine_u16(vshrn_n_u32(a0, GRAY_SHIFT), vshrn_n_u32(a1, GRAY_SHIFT));
+            uint16x8_t hi = vcombine_u16(vshrn_n_u32(a2, GRAY_SHIFT), vshrn_n_u32(a3, GRAY_SHIFT));
+            vst1q_u8(dst + 1 + x, vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+        }
+#endif
+        static const struct Table {
+            int t0[256], t1[256], t2[256];
+            Table() {
+                for(int i = 0; i < 256; i++) {
+                    t0[i] = i * GRAY_COEFF_0;
+                    t1[i] = i * GRAY_COEFF_1;
+                    t2[i] = i * GRAY_COEFF_2 + (1 << (GRAY_SHIFT - 1));
+                }
+            }
+        } table;
+
+        for(; x < width; x++) {
+            const uchar* p = src + 3 * x;
+            dst[1 + x] = static_cast<uchar>((table.t0[p[0]] + table.t1[p[1]] + table.t2[p[2]]) >> GRAY_SHIFT);
+        }
+
+        // Replicate border.
+        dst[0] = dst[1];
+        dst[width + 1] = dst[width];
+    }
+
+    //! @brief Copies a grayscale row into a padded buffer.
+    void copyRow(const uchar* src, uchar* dst, int width) {
+        std::copy(src, src + width, dst + 1);
+
+        // Replicate border.
+        dst[0] = dst[1];
+        dst[width + 1] = dst[width];
+    }
+
+    //! @brief Binarizes a row by the given threshold, writing it into a padded buffer.
+    void thresholdRow(const uchar* src, uchar* dst, int width, uchar thresh) {
+        int x = 0;
+        if(thresh == 255) {
+            std::fill(dst, dst + width + 2, 0);
+            return;
+        }
+#ifdef QR_HAVE_VECTOR_OPS
+        for(; x + VectorOps::WIDTH <= width; x += VectorOps::WIDTH)
+            VectorOps::store(dst + 1 + x, VectorOps::greater(VectorOps::load(src + x), thresh));
+#endif
+        for(; x < width; x++)
+            dst[1 + x] = (src[x] > thresh) ? 255 : 0;
+
+        // Replicate border.
+        dst[0] = dst[1];
+        dst[width + 1] = dst[width];
+    }
+
+    /**
+     * Determines the optimal threshold of a histogram, following Otsu's method.
+     * Mirrors the computation of cv::threshold, to yield the very same threshold.
+     */
+    int otsuThreshold(const int* histogram, int total) {
+        const int N = 256;
+        double mu = 0, scale = 1.0 / total;
+        for(int i = 0; i < N; i++)
+            mu += i * static_cast<double>(histogram[i]);
+        mu *= scale;
+
+        double mu1 = 0, q1 = 0;
+        double maxSigma = 0, maxVal = 0;
+        for(int i = 0; i < N; i++) {
+            double p_i = histogram[i] * scale;
+            mu1 *= q1;
+            q1 += p_i;
+            double q2 = 1.0 - q1;
+
+            if(std::min(q1, q2) < FLT_EPSILON || std::max(q1, q2) > 1.0 - FLT_EPSILON)
+                continue;
+
+            mu1 = (mu1 + i * p_i) / q1;
+            double mu2 = (mu - q1 * mu1) / q2;
+            double sigma = q1 * q2 * (mu1 - mu2) * (mu1 - mu2);
+            if(sigma > maxSigma) {
+                maxSigma = sigma;
+                maxVal = i;
+            }
+        }
+
+        return static_cast<int>(maxVal);
+    }
+
+    /**
+     * Implements fusedBinarize, the grayscale rows being provided by loadRow.
+     * @param loadRow converts an input row into a padded grayscale row
+     */
+    template<typename RowLoader>
+    void binarizeRows(const uchar* src, size_t srcStep, uchar* dst, size_t dstStep, int width, int height, uchar* buffer, RowLoader loadRow) {
+        if(width <= 0 || height <= 0)
+            return;
+
+        // Ring buffer holding three padded rows, indexed by row number modulo three.
+        const int padded = width + 2;
+        std::vector<uchar> local;
+        if(!buffer) {
+            local.resize(3 * padded);
+            buffer = local.data();
+        }
+        uchar* const ring = buffer;
+        auto slot = [&](int y) { return ring + (std::min(std::max(y, 0), height - 1) % 3) * padded; };
+
+        // Four interleaved histograms avoid stalls on repeated values.
+        int histograms[4][256] = {{0}};
+
+        // Pass 1: Grayscale conversion, median filter and histogram.
+        loadRow(src, slot(0), width);
+        for(int y = 0; y < height; y++) {
+            if(y + 1 < height)
+                loadRow(src + (y + 1) * srcStep, slot(y + 1), width);
+
+            uchar* out = dst + y * dstStep;
+            medianRow(slot(y - 1), slot(y), slot(y + 1), out, width);
+
+            int x = 0;
+            for(; x + 4 <= width; x += 4) {
+                histograms[0][out[x]]++;
+                histograms[1][out[x + 1]]++;
+                histograms[2][out[x + 2]]++;
+                histograms[3][out[x + 3]]++;
+            }
+            for(; x < width; x++)
+                histograms[0][out[x]]++;
+        }
+
+        int histogram[256];
+        for(int i = 0; i < 256; i++)
+            histogram[i] = histograms[0][i] + histograms[1][i] + histograms[2][i] + histograms[3][i];
+        const uchar thresh = static_cast<uchar>(otsuThreshold(histogram, width * height));
+
+        // Pass 2: Binarization and median filter, in place. Each row is
+        // binarized into the ring buffer before it gets overwritten.
+        thresholdRow(dst, slot(0), width, thresh);
+        for(int y = 0; y < height; y++) {
+            if(y + 1 < height)
+                thresholdRow(dst + (y + 1) * dstStep, slot(y + 1), width, thresh);
+
+            medianRow(slot(y - 1), slot(y), slot(y + 1), dst + y * dstStep, width);
+        }
+    }
+
+    /**
+     * Implements adaptiveBinarize. Keeps the sums of each column over the rows of the
+     * current window, being updated by adding the entering and subtracting the leaving row.
+     * Their prefix sums then yield the sum of any window within the row in O(1).
+     * @param loadRow converts an input row into a padded grayscale row
+     * @param buffer working memory, as being sized by adaptiveBinarize
+     */
+    template<typename RowLoader>
+    void adaptiveRows(const uchar* src, size_t srcStep, uchar* dst, size_t dstStep, int width, int height,
+                      AdaptiveMethod method, int radius, float k, uchar* buffer, RowLoader loadRow) {
+        const int ringSize = 2 * radius + 2;
+        int64_t* columnSums = reinterpret_cast<int64_t*>(buffer);
+        int64_t* columnSquares = columnSums + width;
+        int64_t* prefixSums = columnSquares + width;
+        int64_t* prefixSquares = prefixSums + width + 1;
+        uchar* ring = reinterpret_cast<uchar*>(prefixSquares + width + 1);
+        auto rowOf = [&](int y) { return ring + static_cast<size_t>(y % ringSize) * (width + 2) + 1; };
+
+        // Adds (sign 1) or removes (sign -1) a row of the window.
+        auto accumulate = [&](int y, int sign) {
+            const uchar* row = rowOf(y);
+            for(int x = 0; x < width; x++) {
+                columnSums[x] += sign * row[x];
+                columnSquares[x] += sign * row[x] * row[x];
+            }
+        };
+
+        std::fill(columnSums, columnSums + 2 * width, 0);
+        for(int y = 0; y < std::min(radius, height); y++) {
+            loadRow(src + y * srcStep, rowOf(y) - 1, width);
+            accumulate(y, 1);
+        }
+
+        prefixSums[0] = prefixSquares[0] = 0;
+        for(int y = 0; y < height; y++) {
+
+            // Slide the window down, the entering row taking the ring slot of one that has left already.
+            if(y + radius < height) {
+                loadRow(src + (y + radius) * srcStep, rowOf(y + radius) - 1, width);
+                accumulate(y + radius, 1);
+            }
+            if(y - radius - 1 >= 0)
+                accumulate(y - radius - 1, -1);
+            const int rows = std::min(y + radius, height - 1) - std::max(y - radius, 0) + 1;
+
+            for(int x = 0; x < width; x++) {
+                prefixSums[x + 1] = prefixSums[x] + columnSums[x];
+                prefixSquares[x + 1] = prefixSquares[x] + columnSquares[x];
+            }
+
+            const uchar* gray = rowOf(y);
+            uchar* out = dst + y * dstStep;
+            for(int x = 0; x < width; x++) {
+                const int x0 = std::max(x - radius, 0), x1 = std::min(x + radius, width - 1);
+                const float count = static_cast<float>((x1 - x0 + 1) * rows);
+                const float mean = (prefixSums[x1 + 1] - prefixSums[x0]) / count;
+
+                float threshold;
+                if(method == ADAPTIVE_SAUVOLA) {
+                    const float variance = (prefixSquares[x1 + 1] - prefixSquares[x0]) / count - mean * mean;
+                    threshold = mean * (1.0f + k * (std::sqrt(std::max(variance, 0.0f)) / 128.0f - 1.0f));
+                } else {
+                    threshold = mean * (1.0f - k);
+                }
+                out[x] = (gray[x] <= threshold) ? 0 : 255;
+            }
+        }
+    }
+}
+
+void fusedBinarize(const uchar* src, size_t srcStep, uchar* dst, size_t dstStep, int width, int height, uchar* buffer) {
+    binarizeRows(src, srcStep, dst, dstStep, width, height, buffer, grayRow);
+}
+
+void fusedBinarizeGray(const uchar* src, size_t srcStep, uchar* dst, size_t dstStep, int width, int height, uchar* buffer) {
+    binarizeRows(src, srcStep, dst, dstStep, width, height, buffer, copyRow);
+}
+
+void fusedBinarize(const cv::Mat& image, cv::Mat& binary) {
+    std::vector<uchar> buffer;
+    fusedBinarize(image, binary, buffer);
+}
+
+void fusedBinarize(const cv::Mat& image, cv::Mat& binary, std::vector<uchar>& buffer) {
+    CV_Assert(image.type() == CV_8UC3 || image.type() == CV_8UC1);
+
+    binary.create(image.size(), CV_8UC1);
+    buffer.resize(3 * (image.cols + 2));
+    if(image.type() == CV_8UC1)
+        fusedBinarizeGray(image.ptr(), image.step, binary.ptr(), binary.step, image.cols, image.rows, buffer.data());
+    else
+        fusedBinarize(image.ptr(), image.step, binary.ptr(), binary.step, image.cols, image.rows, buffer.data());
+}
+
+void adaptiveBinarize(const cv::Mat& image, cv::Mat& binary, AdaptiveMethod method, int radius, float k, std::vector<uchar>& buffer) {
+    CV_Assert(image.type() == CV_8UC3 || image.type() == CV_8UC1);
+    CV_Assert(radius >= 0);
+
+    // Column and prefix sums, followed by the ring of padded grayscale rows.
+    const int width = image.cols, height = image.rows;
+    buffer.resize(sizeof(int64_t) * (4 * width + 2) + static_cast<size_t>(2 * radius + 2) * (width + 2));
+
+    binary.create(image.size(), CV_8UC1);
+    if(image.type() == CV_8UC1)
+        adaptiveRows(image.ptr(), image.step, binary.ptr(), binary.step, width, height, method, radius, k, buffer.data(), copyRow);
+    else
+        adaptiveRows(image.ptr(), image.step, binary.ptr(), binary.step, width, height, method, radius, k, buffer.data(), grayRow);
+}
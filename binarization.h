@@ -0,0 +1,81 @@
+#ifndef QR_CODE_BINARIZATION_H
+#define QR_CODE_BINARIZATION_H
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * Converts a 3-channel image into a filtered binary image, yielding exactly the same result as
+ *
+ *   cv::cvtColor(image, gray, CV_RGB2GRAY);
+ *   cv::medianBlur(gray, gray, 3);
+ *   cv::threshold(gray, gray, 0, 255, cv::THRESH_OTSU);
+ *   cv::medianBlur(gray, gray, 3);
+ *
+ * but in two passes over the image instead of four. Rows are streamed through
+ * small ring buffers, such that the working set stays in cache. The median filters
+ * and the thresholding use AVX2 or NEON instructions, if available at compile time.
+ * Grayscale images skip the conversion.
+ * @param image the CV_8UC3 or CV_8UC1 input image
+ * @param binary receives the CV_8UC1 binary image
+ */
+void fusedBinarize(const cv::Mat& image, cv::Mat& binary);
+
+/**
+ * Same as above, but keeps the ring buffers in the given vector, such
+ * that repeated calls do not need to allocate them again.
+ * @param image the CV_8UC3 or CV_8UC1 input image
+ * @param binary receives the CV_8UC1 binary image
+ * @param buffer working memory, resized as needed
+ */
+void fusedBinarize(const cv::Mat& image, cv::Mat& binary, std::vector<uchar>& buffer);
+
+/**
+ * Raw implementation of fusedBinarize.
+ * @param src the interleaved 3-channel input pixels
+ * @param srcStep the distance between two input rows in bytes
+ * @param dst the output pixels, one byte per pixel
+ * @param dstStep the distance between two output rows in bytes
+ * @param width the image width
+ * @param height the image height
+ * @param buffer working memory of 3 * (width + 2) bytes, allocated internally if null
+ */
+void fusedBinarize(const uchar* src, size_t srcStep, uchar* dst, size_t dstStep, int width, int height, uchar* buffer = nullptr);
+
+/**
+ * Raw implementation of fusedBinarize for grayscale input, such as the Y plane of a YUV frame.
+ * @param src the input pixels, one byte per pixel
+ * @param srcStep the distance between two input rows in bytes
+ * @param dst the output pixels, one byte per pixel
+ * @param dstStep the distance between two output rows in bytes
+ * @param width the image width
+ * @param height the image height
+ * @param buffer working memory of 3 * (width + 2) bytes, allocated internally if null
+ */
+void fusedBinarizeGray(const uchar* src, size_t srcStep, uchar* dst, size_t dstStep, int width, int height, uchar* buffer = nullptr);
+
+
+// Local thresholds of adaptiveBinarize.
+enum AdaptiveMethod {
+    ADAPTIVE_BRADLEY, // Dark, if below the local mean by the fraction k.
+    ADAPTIVE_SAUVOLA, // Dark, if below mean * (1 + k * (deviation / 128 - 1)).
+};
+
+/**
+ * Converts an image into a binary image by a threshold of its own for each pixel, being
+ * derived from the mean and the standard deviation of the surrounding window. Unlike a
+ * global threshold, this keeps the modules of codes being lit unevenly or partly covered
+ * by glare. Sums of the window are taken from running column sums in the manner of an
+ * integral image, which costs O(1) per pixel regardless of the window size. The image is
+ * processed in a single pass, streaming its grayscale rows through a ring buffer.
+ * Light pixels are 255, dark ones 0.
+ * @param image the CV_8UC3 or CV_8UC1 input image
+ * @param binary receives the CV_8UC1 binary image
+ * @param method the local threshold
+ * @param radius the window covers 2 * radius + 1 pixels per dimension, being clipped at the border
+ * @param k the sensitivity, about 0.15 to 0.2 for Bradley and 0.2 to 0.5 for Sauvola
+ * @param buffer working memory, resized as needed
+ */
+void adaptiveBinarize(const cv::Mat& image, cv::Mat& binary, AdaptiveMethod method, int radius, float k, std::vector<uchar>& buffer);
+
+
+#endif //QR_CODE_BINARIZATION_H
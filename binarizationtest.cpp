@@ -0,0 +1,132 @@
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "binarization.h"
+
+//////////////////////////////////////////////////////
+/// Constants definition section
+///
+static const float BRADLEY_K = 0.15f;
+static const float SAUVOLA_K = 0.34f;
+static const int RADII[] = {0, 1, 2, 7, 31, 200};
+static const cv::Size SIZES[] = {{1, 1}, {1, 17}, {17, 1}, {5, 64}, {64, 5}, {37, 23}, {96, 64}};
+//////////////////////////////////////////////////////
+
+namespace {
+
+    /**
+     * Helper function, creating a synthetic image of dark and light blocks under an uneven
+     * illumination, overlaid by noise. The pixels only depend on the seed.
+     * @param size the image size
+     * @param type CV_8UC1 or CV_8UC3
+     * @param seed the seed of the noise
+     * @return the image
+     */
+    cv::Mat syntheticImage(const cv::Size& size, int type, uint32_t seed) {
+        cv::Mat image(size, type);
+        const int channels = image.channels();
+        for(int y = 0; y < size.height; y++) {
+            uchar* row = image.ptr(y);
+            for(int x = 0; x < size.width; x++) {
+                const int light = 60 + 140 * (x + y) / (size.width + size.height);
+                const bool dark = ((x / 4) ^ (y / 3)) & 1;
+                for(int c = 0; c < channels; c++) {
+                    seed = seed * 1664525u + 1013904223u;
+                    const int noise = static_cast<int>(seed >> 27) - 16;
+                    row[x * channels + c] = cv::saturate_cast<uchar>((dark ? light / 3 : light) + noise + 10 * c);
+                }
+            }
+        }
+        return image;
+    }
+
+    /**
+     * Helper function, binarizing by summing up each pixel's window on its own. Uses the very
+     * same floating point formulas as adaptiveBinarize, such that both agree bit by bit.
+     * @param image the CV_8UC3 or CV_8UC1 input image
+     * @param binary receives the CV_8UC1 binary image
+     * @param method the local threshold
+     * @param radius the window covers 2 * radius + 1 pixels per dimension, being clipped at the border
+     * @param k the sensitivity
+     */
+    void naiveBinarize(const cv::Mat& image, cv::Mat& binary, AdaptiveMethod method, int radius, float k) {
+        cv::Mat gray;
+        if(image.channels() == 1)
+            gray = image;
+        else
+            cv::cvtColor(image, gray, CV_RGB2GRAY);
+
+        binary.create(image.size(), CV_8UC1);
+        for(int y = 0; y < gray.rows; y++) {
+            for(int x = 0; x < gray.cols; x++) {
+                const int x0 = std::max(x - radius, 0), x1 = std::min(x + radius, gray.cols - 1);
+                const int y0 = std::max(y - radius, 0), y1 = std::min(y + radius, gray.rows - 1);
+                int64_t sum = 0, squares = 0;
+                for(int v = y0; v <= y1; v++) {
+                    for(int u = x0; u <= x1; u++) {
+                        const int p = gray.at<uchar>(v, u);
+                        sum += p;
+                        squares += p * p;
+                    }
+                }
+
+                const float count = static_cast<float>((x1 - x0 + 1) * (y1 - y0 + 1));
+                const float mean = sum / count;
+                float threshold;
+                if(method == ADAPTIVE_SAUVOLA) {
+                    const float variance = squares / count - mean * mean;
+                    threshold = mean * (1.0f + k * (std::sqrt(std::max(variance, 0.0f)) / 128.0f - 1.0f));
+                } else {
+                    threshold = mean * (1.0f - k);
+                }
+                binary.at<uchar>(y, x) = (gray.at<uchar>(y, x) <= threshold) ? 0 : 255;
+            }
+        }
+    }
+}
+
+/**
+ * Regression check of adaptiveBinarize, comparing it with summing up each pixel's window
+ * on its own. Covers both thresholds, grayscale and color input, windows being clipped at
+ * the borders and windows exceeding the whole image.
+ */
+int main() {
+    int failures = 0, checks = 0;
+    std::vector<uchar> buffer;
+    for(const cv::Size& size : SIZES) {
+        for(int type : {CV_8UC1, CV_8UC3}) {
+            const cv::Mat image = syntheticImage(size, type, static_cast<uint32_t>(size.area() + type));
+            for(int radius : RADII) {
+                for(AdaptiveMethod method : {ADAPTIVE_BRADLEY, ADAPTIVE_SAUVOLA}) {
+                    const float k = (method == ADAPTIVE_SAUVOLA) ? SAUVOLA_K : BRADLEY_K;
+                    cv::Mat binary, expected;
+
+                    // The buffer is shared between all runs, as by the detector.
+                    adaptiveBinarize(image, binary, method, radius, k, buffer);
+                    naiveBinarize(image, expected, method, radius, k);
+                    checks++;
+
+                    const int differences = cv::countNonZero(binary != expected);
+                    if(differences != 0) {
+                        std::ostringstream label;
+                        label << size.width << "x" << size.height << (type == CV_8UC1 ? " gray" : " color")
+                              << (method == ADAPTIVE_SAUVOLA ? " sauvola" : " bradley") << " radius " << radius;
+                        std::cout << "FAILED " << label.str() << ": " << differences << " pixels differ" << std::endl;
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+
+    std::cout << checks - failures << "/" << checks << " binarizations match" << std::endl;
+    std::cout << (failures ? "Binarization regression failed." : "Binarization regression passed.") << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,180 @@
+#include "bitmatrix.h"
+
+#include <cstring>
+
+namespace {
+
+    const char MAGIC[4] = {'Q', 'R', 'B', 'M'};
+
+    // Flags of a record.
+    const uchar FLAG_CORNERS = 1;
+
+    //! @brief Counts the set bits of a word.
+    inline int popcount(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(word);
+#else
+        word = word - ((word >> 1) & 0x5555555555555555ULL);
+        word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+        word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+        return static_cast<int>((word * 0x0101010101010101ULL) >> 56);
+#endif
+    }
+
+    //! @brief Determines the QR version of the given size, or 0 if there is none.
+    int versionOfSize(int size) {
+        int version = (size - 17) / 4;
+        return (size >= 21 && size <= 177 && (size - 17) % 4 == 0) ? version : 0;
+    }
+
+    //! @brief Checks whether a record may hold the given size, being either a QR version or empty.
+    bool isRecordSize(int size) {
+        return size == 0 || versionOfSize(size) != 0;
+    }
+
+    //! @brief Appends a float as 32 bit little endian value.
+    void putFloat(std::vector<uchar>& buffer, float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for(int i = 0; i < 4; i++)
+            buffer.push_back(static_cast<uchar>(bits >> (8 * i)));
+    }
+
+    //! @brief Reads a float from a 32 bit little endian value.
+    float getFloat(const uchar* p) {
+        uint32_t bits = static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+                        (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+}
+
+BitMatrix::BitMatrix()
+    : size_(0)
+    , wordsPerRow_(0)
+{
+}
+
+BitMatrix::BitMatrix(int size)
+    : BitMatrix()
+{
+    create(size);
+}
+
+void BitMatrix::create(int size) {
+    size_ = std::max(0, size);
+    wordsPerRow_ = (size_ + 63) / 64;
+    words_.assign(static_cast<size_t>(size_) * wordsPerRow_, 0);
+}
+
+int BitMatrix::countDifferences(const BitMatrix& other) const {
+    if(size_ != other.size_)
+        return -1;
+
+    // Bits beyond the last column are cleared in both, so they never differ.
+    int differences = 0;
+    const size_t count = static_cast<size_t>(size_) * wordsPerRow_;
+    for(size_t i = 0; i < count; i++)
+        differences += popcount(words_[i] ^ other.words_[i]);
+
+    return differences;
+}
+
+bool BitMatrix::fromMat(const cv::Mat& code) {
+    if(code.type() != CV_8UC1 || code.rows != code.cols) {
+        release();
+        return false;
+    }
+
+    create(code.rows);
+    for(int r = 0; r < size_; r++) {
+        const uchar* src = code.ptr(r);
+        uint64_t* dst = row(r);
+        for(int c = 0; c < size_; c++)
+            dst[c >> 6] |= static_cast<uint64_t>(src[c] < 128) << (c & 63);
+    }
+    return true;
+}
+
+void BitMatrix::toMat(cv::Mat& code) const {
+    code.create(size_, size_, CV_8UC1);
+    for(int r = 0; r < size_; r++) {
+        const uint64_t* src = row(r);
+        uchar* dst = code.ptr(r);
+        for(int c = 0; c < size_; c++)
+            dst[c] = ((src[c >> 6] >> (c & 63)) & 1) ? 0 : 255;
+    }
+}
+
+bool BitMatrix::write(std::ostream& stream, const cv::Point2f* corners) const {
+    if(!isRecordSize(size_))
+        return false;
+
+    const int bytesPerRow = (size_ + 7) / 8;
+    std::vector<uchar> buffer(MAGIC, MAGIC + sizeof(MAGIC));
+    buffer.push_back(RECORD_FORMAT);
+    buffer.push_back(corners ? FLAG_CORNERS : 0);
+    buffer.push_back(static_cast<uchar>(versionOfSize(size_)));
+    buffer.push_back(0);
+    buffer.push_back(static_cast<uchar>(size_ & 0xff));
+    buffer.push_back(static_cast<uchar>(size_ >> 8));
+    if(corners) {
+        for(int i = 0; i < 4; i++) {
+            putFloat(buffer, corners[i].x);
+            putFloat(buffer, corners[i].y);
+        }
+    }
+
+    // Each row is cut down to whole bytes, the words being little endian anyway.
+    buffer.reserve(buffer.size() + static_cast<size_t>(bytesPerRow) * size_);
+    for(int r = 0; r < size_; r++) {
+        const uint64_t* words = row(r);
+        for(int b = 0; b < bytesPerRow; b++)
+            buffer.push_back(static_cast<uchar>(words[b >> 3] >> (8 * (b & 7))));
+    }
+
+    stream.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    return static_cast<bool>(stream);
+}
+
+bool BitMatrix::read(std::istream& stream, std::vector<cv::Point2f>* corners) {
+    uchar header[10];
+    if(!stream.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+       std::memcmp(header, MAGIC, sizeof(MAGIC)) != 0 || header[4] != RECORD_FORMAT)
+        return false;
+
+    const bool hasCorners = (header[5] & FLAG_CORNERS) != 0;
+    // Refuse foreign sizes, instead of allocating whatever the record claims.
+    const int size = header[8] | (header[9] << 8);
+    if(!isRecordSize(size))
+        return false;
+
+    if(corners)
+        corners->clear();
+    if(hasCorners) {
+        uchar values[32];
+        if(!stream.read(reinterpret_cast<char*>(values), sizeof(values)))
+            return false;
+        for(int i = 0; corners && i < 4; i++)
+            corners->push_back(cv::Point2f(getFloat(&values[8 * i]), getFloat(&values[8 * i + 4])));
+    }
+
+    create(size);
+    const int bytesPerRow = (size + 7) / 8;
+    std::vector<uchar> bytes(bytesPerRow);
+    for(int r = 0; r < size; r++) {
+        if(!stream.read(reinterpret_cast<char*>(bytes.data()), bytesPerRow)) {
+            release();
+            return false;
+        }
+        uint64_t* words = row(r);
+        for(int b = 0; b < bytesPerRow; b++)
+            words[b >> 3] |= static_cast<uint64_t>(bytes[b]) << (8 * (b & 7));
+
+        // Keep the bits beyond the last column cleared, even for foreign records.
+        if(size & 63)
+            words[wordsPerRow_ - 1] &= (static_cast<uint64_t>(1) << (size & 63)) - 1;
+    }
+    return true;
+}
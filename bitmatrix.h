@@ -0,0 +1,110 @@
+#ifndef QR_CODE_BITMATRIX_H
+#define QR_CODE_BITMATRIX_H
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * Square module matrix of a normalized QR code, holding one bit per module.
+ * Each row starts at a 64 bit word of its own, set bits being dark modules.
+ * Bits beyond the last column are always cleared, such that whole words
+ * can be compared.
+ *
+ * A matrix is stored as a compact record, all values being little endian:
+ *
+ *   char[4] magic     "QRBM"
+ *   uint8   format    record format, currently 1
+ *   uint8   flags     bit 0 set, if the corners follow
+ *   uint8   version   QR version between 1 and 40, or 0 if no code has been found
+ *   uint8   reserved  0
+ *   uint16  size      modules per row and column, 17 + 4 * version or 0
+ *   float32[8]        corners a, b, c, d as x, y inside the source image, if flagged
+ *   rows              (size + 7) / 8 bytes each, module c being bit c % 8 of byte c / 8
+ */
+class BitMatrix {
+
+    // Version of the record format being written.
+    static constexpr int RECORD_FORMAT = 1;
+
+public:
+
+    BitMatrix();
+
+    explicit BitMatrix(int size);
+
+    //! @brief Resizes the matrix to size x size modules, all being light. Keeps the allocated memory.
+    void create(int size);
+
+    //! @brief Clears the matrix to zero modules.
+    void release() { size_ = 0; wordsPerRow_ = 0; }
+
+    int size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    //! @brief Number of 64 bit words per row.
+    int wordsPerRow() const { return wordsPerRow_; }
+
+    const uint64_t* row(int r) const { return &words_[r * wordsPerRow_]; }
+
+    uint64_t* row(int r) { return &words_[r * wordsPerRow_]; }
+
+    //! @brief Whether the module in row r and column c is dark.
+    bool get(int r, int c) const {
+        return (row(r)[c >> 6] >> (c & 63)) & 1;
+    }
+
+    //! @brief Sets the module in row r and column c.
+    void set(int r, int c, bool dark) {
+        uint64_t& word = row(r)[c >> 6];
+        const uint64_t bit = static_cast<uint64_t>(1) << (c & 63);
+        word = dark ? (word | bit) : (word & ~bit);
+    }
+
+    /**
+     * Counts the differing modules of two matrices, by XOR-ing whole words.
+     * @param other the matrix to compare with
+     * @return the number of differing modules, or -1 if the sizes do not match
+     */
+    int countDifferences(const BitMatrix& other) const;
+
+    /**
+     * Packs a normalized QR code.
+     * @param code the CV_8UC1 module matrix, one pixel per module, dark modules being below 128
+     * @return false, if the matrix is not square or not CV_8UC1
+     */
+    bool fromMat(const cv::Mat& code);
+
+    //! @brief Unpacks into a CV_8UC1 module matrix, dark modules being 0 and light ones 255.
+    void toMat(cv::Mat& code) const;
+
+    /**
+     * Writes the matrix as compact record. Empty matrices are written as well,
+     * telling that no code has been found.
+     * @param stream the stream to write to
+     * @param corners optional corners a, b, c and d of the code inside its source image
+     * @return false, if the size does not match any QR version or writing failed
+     */
+    bool write(std::ostream& stream, const cv::Point2f* corners = nullptr) const;
+
+    /**
+     * Reads a compact record.
+     * @param stream the stream to read from
+     * @param corners optionally receives the corners a, b, c and d
+     * @return false, if the record is malformed or its size does not match any QR version
+     */
+    bool read(std::istream& stream, std::vector<cv::Point2f>* corners = nullptr);
+
+private:
+
+    int size_;
+    int wordsPerRow_;
+    std::vector<uint64_t> words_;
+};
+
+
+#endif //QR_CODE_BITMATRIX_H
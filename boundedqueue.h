@@ -0,0 +1,71 @@
+#ifndef QR_CODE_BOUNDEDQUEUE_H
+#define QR_CODE_BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/**
+ * A simple blocking FIFO queue holding at most a fixed amount of elements.
+ * Producers block while the queue is full, consumers block while it is empty.
+ * Once closed, pending elements can still be popped, but no new ones are accepted.
+ */
+template<typename T>
+class BoundedQueue {
+public:
+
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity > 0 ? capacity : 1), closed_(false) {}
+
+    /**
+     * Appends an element, waiting for free space if necessary.
+     * @param value the element to be appended
+     * @return false, if the queue has been closed in the meantime
+     */
+    bool push(T value) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return closed_ || queue_.size() < capacity_; });
+        if(closed_)
+            return false;
+
+        queue_.push_back(std::move(value));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    /**
+     * Removes the first element, waiting for one to arrive if necessary.
+     * @param value receives the element
+     * @return false, if the queue has been closed and is drained
+     */
+    bool pop(T& value) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+        if(queue_.empty())
+            return false;
+
+        value = std::move(queue_.front());
+        queue_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    //! @brief Wakes up all waiting threads and rejects further elements.
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+
+private:
+
+    const size_t capacity_;
+    bool closed_;
+    std::deque<T> queue_;
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+};
+
+
+#endif //QR_CODE_BOUNDEDQUEUE_H
@@ -0,0 +1,93 @@
+#include <opencv2/opencv.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "batchprocessor.h"
+#include "qrcache.h"
+#include "qrdetector.h"
+#include "qrutils.h"
+
+//////////////////////////////////////////////////////
+/// Constants definition section
+///
+static const char* DEFAULT_IMAGES = "tests/images";
+static const double SHIFT_MODULES = 4.0;
+static const float MAX_CORNER_DISTANCE = 2.0f;
+//////////////////////////////////////////////////////
+
+/**
+ * Regression check of the result cache, feeding each image of tests/images twice and
+ * once more with its content shifted by a few modules. The repeated frame has to be
+ * taken from the cache, yielding the very same code, while the shifted one has to be
+ * detected again at its new position. A blank frame must never be cached. Run from the
+ * source directory, or pass the image directory.
+ */
+int main(int argc, char** argv) {
+    std::string imageDir = (argc > 1) ? argv[1] : DEFAULT_IMAGES;
+
+    QRDetector detector;
+    int failures = 0, found = 0;
+
+    // A frame without any code is detected from scratch every time.
+    {
+        QRResultCache cache(detector);
+        cv::Mat blank(1080, 1920, CV_8UC3, cv::Scalar(128, 128, 128));
+        cache.detect(blank);
+        if(!cache.detect(blank).empty() || cache.lastFrameCached() || cache.hits() != 0 || cache.misses() != 2) {
+            std::cout << "FAILED blank frame: cached" << std::endl;
+            failures++;
+        }
+    }
+
+    const std::vector<std::string> inputs = BatchProcessor::collectInputs(imageDir);
+    for(const std::string& input : inputs) {
+        cv::Mat image = cv::imread(input);
+        if(image.empty()) {
+            std::cout << "FAILED " << input << ": cannot load the image" << std::endl;
+            failures++;
+            continue;
+        }
+
+        // Codes the detector does not locate on the full frame are not cached at all.
+        QRResultCache cache(detector);
+        cv::Mat expected = cache.detect(image).clone();
+        if(expected.empty())
+            continue;
+        const QRDetector::QRCode code = *cache.code();
+        found++;
+
+        // The same frame again, which has to be a hit.
+        cv::Mat cached = cache.detect(image);
+        cv::Mat diff;
+        if(!cache.lastFrameCached() || cached.empty() || compareWithReference(cached, expected, diff) != 0) {
+            std::cout << "FAILED " << input << ": same frame not taken from the cache" << std::endl;
+            failures++;
+        }
+
+        // Shift the content, such that the cached corners point at different modules.
+        const int shift = cvRound(SHIFT_MODULES * cv::norm(code.c - code.b) / expected.cols);
+        cv::Mat moved;
+        cv::copyMakeBorder(image(cv::Rect(0, 0, image.cols - shift, image.rows)), moved, 0, 0, shift, 0, cv::BORDER_REPLICATE);
+        cv::Mat result = cache.detect(moved);
+        const QRDetector::QRCode* located = cache.code();
+        if(cache.lastFrameCached()) {
+            std::cout << "FAILED " << input << ": moved code taken from the cache" << std::endl;
+            failures++;
+        } else if(!result.empty() && (!located || cv::norm(located->b - (code.b + cv::Point2f(static_cast<float>(shift), 0.0f))) > MAX_CORNER_DISTANCE)) {
+            std::cout << "FAILED " << input << ": moved code not located at its new position" << std::endl;
+            failures++;
+        }
+
+        std::cout << input << ": " << cache.hits() << " hits, " << cache.misses() << " misses, "
+                  << cache.rejected() << " rejected" << std::endl;
+    }
+    if(found == 0) {
+        std::cout << "FAILED " << imageDir << ": no codes found" << std::endl;
+        failures++;
+    }
+
+    std::cout << (failures ? "Cache regression failed." : "Cache regression passed.") << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
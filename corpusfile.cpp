@@ -0,0 +1,210 @@
+#include "corpusfile.h"
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitmatrix.h"
+#include "qrutils.h"
+
+namespace {
+
+    const char MAGIC[8] = {'Q', 'R', 'C', 'O', 'R', 'P', 'U', 'S'};
+
+    // Size of magic, version and count.
+    const size_t HEADER_SIZE = 16;
+
+    //! @brief Rounds value up to a multiple of alignment.
+    size_t alignUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    //! @brief Checks whether the range lies within a file of the given length.
+    bool inside(uint64_t offset, uint64_t size, size_t length) {
+        return offset <= length && size <= length - offset;
+    }
+}
+
+CorpusFile::CorpusFile()
+    : data_(nullptr)
+    , length_(0)
+    , count_(0)
+{
+}
+
+CorpusFile::~CorpusFile() {
+    close();
+}
+
+bool CorpusFile::write(const std::string& path, const std::vector<std::string>& inputs, const std::string& referenceDir,
+                       std::vector<std::string>* failed) {
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if(!out)
+        return false;
+
+    // Reserve the header and the index, which is written once all offsets are known.
+    std::vector<Entry> entries;
+    entries.reserve(inputs.size());
+    size_t offset = HEADER_SIZE + inputs.size() * sizeof(Entry);
+    out.write(std::string(offset, '\0').data(), offset);
+
+    const char padding[FRAME_ALIGNMENT] = {};
+    std::vector<char> row;
+    BitMatrix bits;
+    for(const std::string& input : inputs) {
+        // Convert the same way the detector converts images read from file, as the
+        // codec's own grayscale decoding weighs the channels differently.
+        cv::Mat decoded = cv::imread(input);
+        if(decoded.empty()) {
+            if(failed)
+                failed->push_back(input);
+            continue;
+        }
+        cv::Mat image;
+        cv::cvtColor(decoded, image, CV_RGB2GRAY);
+
+        Entry entry = {};
+        entry.width = static_cast<uint32_t>(image.cols);
+        entry.height = static_cast<uint32_t>(image.rows);
+        entry.stride = static_cast<uint32_t>(alignUp(image.cols, ROW_ALIGNMENT));
+
+        // Pixels, each row being padded to the stride.
+        const size_t aligned = alignUp(offset, FRAME_ALIGNMENT);
+        out.write(padding, aligned - offset);
+        offset = aligned;
+        entry.imageOffset = offset;
+        row.assign(entry.stride, 0);
+        for(int r = 0; r < image.rows; r++) {
+            std::memcpy(row.data(), image.ptr(r), image.cols);
+            out.write(row.data(), row.size());
+        }
+        offset += static_cast<size_t>(entry.stride) * entry.height;
+
+        entry.nameOffset = offset;
+        entry.nameLength = static_cast<uint32_t>(input.size());
+        out.write(input.data(), input.size());
+        offset += input.size();
+
+        if(!referenceDir.empty()) {
+            cv::Mat reference = cv::imread(referenceFile(input, referenceDir), cv::IMREAD_GRAYSCALE);
+            std::ostringstream record;
+            if(!reference.empty() && bits.fromMat(reference) && bits.write(record)) {
+                const std::string bytes = record.str();
+                entry.referenceOffset = offset;
+                entry.referenceLength = static_cast<uint32_t>(bytes.size());
+                out.write(bytes.data(), bytes.size());
+                offset += bytes.size();
+            }
+        }
+
+        entries.push_back(entry);
+    }
+
+    // Header and index, leaving the entries of failed images unused at the end.
+    const uint32_t version = FORMAT_VERSION;
+    const uint32_t count = static_cast<uint32_t>(entries.size());
+    out.seekp(0);
+    out.write(MAGIC, sizeof(MAGIC));
+    out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(Entry));
+
+    return static_cast<bool>(out);
+}
+
+bool CorpusFile::isCorpusFile(const std::string& path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    char magic[sizeof(MAGIC)];
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+bool CorpusFile::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(HEADER_SIZE)) {
+        ::close(fd);
+        return false;
+    }
+
+    // Private writable pages, such that frames can be handed out as ordinary matrices.
+    const size_t length = static_cast<size_t>(info.st_size);
+    void* data = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED)
+        return false;
+    madvise(data, length, MADV_SEQUENTIAL);
+
+    data_ = static_cast<uchar*>(data);
+    length_ = length;
+
+    uint32_t version, count;
+    std::memcpy(&version, data_ + sizeof(MAGIC), sizeof(version));
+    std::memcpy(&count, data_ + sizeof(MAGIC) + sizeof(version), sizeof(count));
+    if(std::memcmp(data_, MAGIC, sizeof(MAGIC)) != 0 || version != FORMAT_VERSION ||
+       !inside(HEADER_SIZE, static_cast<uint64_t>(count) * sizeof(Entry), length_)) {
+        close();
+        return false;
+    }
+
+    // Check each entry once, such that the accessors can rely on it.
+    count_ = count;
+    for(size_t i = 0; i < count_; i++) {
+        const Entry& e = entry(i);
+        if(e.width == 0 || e.height == 0 || e.stride < e.width ||
+           !inside(e.imageOffset, static_cast<uint64_t>(e.stride) * e.height, length_) ||
+           !inside(e.nameOffset, e.nameLength, length_) ||
+           !inside(e.referenceOffset, e.referenceLength, length_)) {
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void CorpusFile::close() {
+    if(data_)
+        munmap(data_, length_);
+    data_ = nullptr;
+    length_ = 0;
+    count_ = 0;
+}
+
+std::string CorpusFile::name(size_t i) const {
+    const Entry& e = entry(i);
+    return std::string(reinterpret_cast<const char*>(data_ + e.nameOffset), e.nameLength);
+}
+
+cv::Mat CorpusFile::image(size_t i) const {
+    const Entry& e = entry(i);
+    return cv::Mat(static_cast<int>(e.height), static_cast<int>(e.width), CV_8UC1, data_ + e.imageOffset, e.stride);
+}
+
+bool CorpusFile::reference(size_t i, cv::Mat& reference) const {
+    const Entry& e = entry(i);
+    BitMatrix bits;
+    std::istringstream record(std::string(reinterpret_cast<const char*>(data_ + e.referenceOffset), e.referenceLength));
+    if(e.referenceLength == 0 || !bits.read(record) || bits.empty()) {
+        reference.release();
+        return false;
+    }
+
+    bits.toMat(reference);
+    return true;
+}
+
+const CorpusFile::Entry& CorpusFile::entry(size_t i) const {
+    assert(i < count_);
+    return reinterpret_cast<const Entry*>(data_ + HEADER_SIZE)[i];
+}
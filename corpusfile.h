@@ -0,0 +1,116 @@
+#ifndef QR_CODE_CORPUSFILE_H
+#define QR_CODE_CORPUSFILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * A corpus of pre-decoded grayscale frames in a single file, being mapped into memory
+ * as a whole. Frames are handed out as views right into the mapping, such that reading
+ * a frame costs nothing but the page faults, instead of decoding an image file.
+ *
+ * All values are stored in the byte order of the host, which must be little endian:
+ *
+ *   char[8]  magic     "QRCORPUS"
+ *   uint32   version   format version, currently 1
+ *   uint32   count     number of frames
+ *   Entry[count]       index, see below
+ *   data               pixels, names and references, pixels starting at multiples of 64 bytes
+ *
+ * Each frame's rows are padded to a stride of a multiple of 16 bytes. References are
+ * stored as BitMatrix records, see there.
+ */
+class CorpusFile {
+
+    // Version of the format being written.
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    // Alignment of the first pixel of each frame, and of each row.
+    static constexpr size_t FRAME_ALIGNMENT = 64;
+    static constexpr size_t ROW_ALIGNMENT = 16;
+
+public:
+
+    // Index entry of a frame, offsets being relative to the start of the file.
+    struct Entry {
+        uint64_t imageOffset;
+        uint64_t nameOffset;
+        uint64_t referenceOffset;
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;
+        uint32_t nameLength;
+        uint32_t referenceLength; // 0, if there is no reference.
+        uint32_t reserved;
+    };
+
+    CorpusFile();
+
+    //! @brief Unmaps the file, invalidating all views.
+    ~CorpusFile();
+
+    CorpusFile(const CorpusFile&) = delete;
+    CorpusFile& operator=(const CorpusFile&) = delete;
+
+    /**
+     * Decodes images into a corpus file. Each image is converted into grayscale the way
+     * the detector converts color images, such that a frame yields the same result as
+     * its image file. References are looked up by referenceFile, see qrutils.h.
+     * @param path the corpus file to be written
+     * @param inputs the image files
+     * @param referenceDir optional directory holding the references
+     * @param failed optionally receives the images, which could not be loaded and are left out
+     * @return false, if the corpus file could not be written
+     */
+    static bool write(const std::string& path, const std::vector<std::string>& inputs, const std::string& referenceDir = "",
+                      std::vector<std::string>* failed = nullptr);
+
+    //! @brief Checks whether the given file starts like a corpus file.
+    static bool isCorpusFile(const std::string& path);
+
+    /**
+     * Maps a corpus file into memory, after checking its index.
+     * @param path the corpus file
+     * @return false, if the file could not be mapped or is malformed
+     */
+    bool open(const std::string& path);
+
+    //! @brief Unmaps the file, invalidating all views.
+    void close();
+
+    //! @brief Number of frames.
+    size_t size() const { return count_; }
+
+    //! @brief Name of a frame, being the path of the image it has been decoded from.
+    std::string name(size_t i) const;
+
+    /**
+     * Returns a frame without copying it. Writing into it only affects this mapping.
+     * @param i the index of the frame
+     * @return the CV_8UC1 view, valid until the file is closed
+     */
+    cv::Mat image(size_t i) const;
+
+    /**
+     * Unpacks the reference of a frame.
+     * @param i the index of the frame
+     * @param reference receives the CV_8UC1 module matrix, or an empty matrix if there is none
+     * @return false, if the frame has no reference
+     */
+    bool reference(size_t i, cv::Mat& reference) const;
+
+private:
+
+    //! @brief Returns the index entry of a frame.
+    const Entry& entry(size_t i) const;
+
+    uchar* data_;
+    size_t length_;
+    size_t count_;
+};
+
+
+#endif //QR_CODE_CORPUSFILE_H
@@ -0,0 +1,74 @@
+#include <opencv2/opencv.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "batchprocessor.h"
+#include "corpusfile.h"
+#include "qrdetector.h"
+#include "qrutils.h"
+
+//////////////////////////////////////////////////////
+/// Constants definition section
+///
+static const char* DEFAULT_IMAGES = "tests/images";
+static const char* DEFAULT_REFERENCES = "tests/references";
+static const char* CORPUS_FILE = "qr_corpus_test.corpus";
+//////////////////////////////////////////////////////
+
+/**
+ * Regression check of the corpus format, packing tests/images into a corpus file and
+ * detecting each frame as well as its source image. Both have to yield the very same
+ * modules, the binary image being computed from the same grayscale pixels. Codes are
+ * sampled directly from the full resolution image, as rescaling color and grayscale
+ * images rounds differently. Run from the source directory, or pass the image and
+ * reference directories.
+ */
+int main(int argc, char** argv) {
+    std::string imageDir = (argc > 1) ? argv[1] : DEFAULT_IMAGES;
+    std::string referenceDir = (argc > 2) ? argv[2] : DEFAULT_REFERENCES;
+
+    const std::vector<std::string> inputs = BatchProcessor::collectInputs(imageDir);
+    std::vector<std::string> failed;
+    CorpusFile corpus;
+    if(inputs.empty() || !CorpusFile::write(CORPUS_FILE, inputs, referenceDir, &failed) || !failed.empty() ||
+       !corpus.open(CORPUS_FILE) || corpus.size() != inputs.size()) {
+        std::cout << "FAILED " << imageDir << ": cannot pack the images" << std::endl;
+        std::remove(CORPUS_FILE);
+        return EXIT_FAILURE;
+    }
+
+    QRDetector detector;
+    detector.setDirectSampling(true);
+    QRDetectorContext context;
+
+    int failures = 0;
+    for(size_t i = 0; i < corpus.size(); i++) {
+        const std::string name = corpus.name(i);
+        cv::Mat image = cv::imread(name);
+        cv::Mat expected = detector.detectQRCode(image, context).clone();
+        cv::Mat code = detector.detectQRCode(corpus.image(i), context);
+
+        cv::Mat diff;
+        if(expected.empty() != code.empty() || (!code.empty() && compareWithReference(code, expected, diff) != 0)) {
+            std::cout << "FAILED " << name << ": frame differs from its image" << std::endl;
+            failures++;
+        }
+
+        cv::Mat reference, packed;
+        reference = cv::imread(referenceFile(name, referenceDir), cv::IMREAD_GRAYSCALE);
+        corpus.reference(i, packed);
+        if(reference.empty() != packed.empty() || (!packed.empty() && compareWithReference(packed, reference, diff) != 0)) {
+            std::cout << "FAILED " << name << ": reference differs" << std::endl;
+            failures++;
+        }
+    }
+
+    corpus.close();
+    std::remove(CORPUS_FILE);
+
+    std::cout << (failures ? "Corpus regression failed." : "Corpus regression passed.") << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+#include <opencv2/opencv.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "qrdecoder.h"
+
+//////////////////////////////////////////////////////
+/// Constants definition section
+///
+static const char* DEFAULT_REFERENCES = "tests/references";
+//////////////////////////////////////////////////////
+
+namespace {
+
+    // A reference grid along with its known payload.
+    struct Expected {
+        const char* name;
+        int version;
+        const char* payload;
+    };
+
+    const Expected EXPECTED[] = {
+        {"amazon", 2, "https://www.amazon.de"},
+        {"facebook", 2, "http://www.facebook.de"},
+        {"google", 2, "https://www.google.de"},
+        {"hallo", 4, "Hallooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooooo"},
+        {"reddit", 2, "https://www.reddit.com"},
+        {"test", 1, "Teste mich!"},
+        {"test1", 1, "Test 1"},
+        {"test2", 1, "Test 2"},
+        {"web", 1, "http://www.web.de"},
+        {"wwu", 2, "https://www.wwu.de"},
+    };
+
+    /**
+     * Helper function, decoding a grid and comparing it with the expected payload.
+     * @param label the name of the check being printed on failure
+     * @param code the grid
+     * @param payload the expected payload
+     * @param result receives the outcome of the decoder
+     * @return false, if the grid could not be decoded or the payload differs
+     */
+    bool check(const std::string& label, const cv::Mat& code, const std::string& payload, QRDecoder::Result& result) {
+        QRDecoder decoder;
+        result = decoder.decode(code);
+        if(result.status != QRDecoder::STATUS_OK) {
+            std::cout << "FAILED " << label << ": status " << result.status << std::endl;
+            return false;
+        }
+        if(result.payload != payload) {
+            std::cout << "FAILED " << label << ": payload \"" << result.payload << "\"" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    //! @brief Inverts the modules of the given block.
+    void flipModules(cv::Mat& code, int row, int col, int rows, int cols) {
+        for(int r = row; r < row + rows; r++) {
+            for(int c = col; c < col + cols; c++)
+                code.ptr(r)[c] = 255 - code.ptr(r)[c];
+        }
+    }
+}
+
+/**
+ * Regression check of the decoder, decoding the reference grids into their known
+ * payloads. Besides the grids as they are, a transposed grid and a grid with whole
+ * codewords being inverted are checked, the latter having to be corrected by the
+ * Reed-Solomon decoder. Run from the source directory, or pass the reference directory.
+ */
+int main(int argc, char** argv) {
+    std::string referenceDir = (argc > 1) ? argv[1] : DEFAULT_REFERENCES;
+
+    int failures = 0;
+    for(const Expected& expected : EXPECTED) {
+        cv::Mat code = cv::imread(referenceDir + "/" + expected.name + ".png", cv::IMREAD_GRAYSCALE);
+        if(code.empty()) {
+            std::cout << "FAILED " << expected.name << ": cannot load the reference" << std::endl;
+            failures++;
+            continue;
+        }
+
+        QRDecoder::Result result;
+        if(!check(expected.name, code, expected.payload, result)) {
+            failures++;
+            continue;
+        }
+        if(result.version != expected.version || result.correctedErrors != 0 || result.mirrored) {
+            std::cout << "FAILED " << expected.name << ": version " << result.version << ", "
+                      << result.correctedErrors << " corrections, mirrored " << result.mirrored << std::endl;
+            failures++;
+        }
+
+        // Mirrored codes are decoded with rows and columns being swapped.
+        cv::Mat transposed(code.cols, code.rows, CV_8UC1);
+        for(int r = 0; r < code.rows; r++) {
+            for(int c = 0; c < code.cols; c++)
+                transposed.ptr(c)[r] = code.ptr(r)[c];
+        }
+        if(!check(std::string(expected.name) + " (mirrored)", transposed, expected.payload, result)) {
+            failures++;
+        } else if(!result.mirrored) {
+            std::cout << "FAILED " << expected.name << " (mirrored): not reported as mirrored" << std::endl;
+            failures++;
+        }
+
+        // Level L corrects up to 3 codewords in version 1. The rightmost two columns
+        // hold the first three data codewords from the bottom up to row 9, each being
+        // a block of 2x4 modules, which are inverted as a whole.
+        if(expected.version == 1) {
+            cv::Mat corrupted = code.clone();
+            flipModules(corrupted, 9, code.cols - 2, 12, 2);
+            if(!check(std::string(expected.name) + " (corrupted)", corrupted, expected.payload, result)) {
+                failures++;
+            } else if(result.correctedErrors != 3) {
+                std::cout << "FAILED " << expected.name << " (corrupted): " << result.correctedErrors << " corrections" << std::endl;
+                failures++;
+            }
+        }
+    }
+
+    std::cout << (failures ? "Decoder regression failed." : "Decoder regression passed.") << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
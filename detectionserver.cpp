@@ -0,0 +1,330 @@
+#include "detectionserver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "boundedqueue.h"
+#include "imageview.h"
+#include "qrdecoder.h"
+#include "qrutils.h"
+
+// Number of requests being buffered between two stages, per thread.
+static const int QUEUE_SIZE_PER_THREAD = 2;
+
+namespace {
+
+    // Kinds of requests.
+    enum Kind {
+        KIND_ENCODED = 0,
+        KIND_RAW = 1,
+    };
+
+    // Request passed from the reading to the detection stage.
+    struct Request {
+        size_t id;
+        std::vector<uchar> data;
+        const char* error; // Set, if the request has been rejected while reading.
+    };
+
+    // Response passed from the detection to the writing stage.
+    struct Response {
+        size_t id;
+        std::string line;
+    };
+
+    //! @brief Reads exactly size bytes, returns false on end of stream or error.
+    bool readFully(int fd, void* data, size_t size) {
+        uchar* p = static_cast<uchar*>(data);
+        while(size > 0) {
+            ssize_t n = ::read(fd, p, size);
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n <= 0)
+                return false;
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    //! @brief Writes exactly size bytes, returns false on error.
+    bool writeFully(int fd, const char* data, size_t size) {
+        while(size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n <= 0)
+                return false;
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    //! @brief Reads a 32 bit little endian value.
+    uint32_t readUInt32(const uchar* p) {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+               (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    //! @brief Builds the response to a malformed request.
+    std::string errorResponse(size_t id, const char* message) {
+        std::ostringstream line;
+        line << "{\"id\": " << id << ", \"error\": " << quoteJson(message) << "}\n";
+        return line.str();
+    }
+
+    /**
+     * Helper function, turning a request into an image. Raw frames are referenced in place.
+     * @param data the request
+     * @param buffer receives the luminance of packed frames, or the decoded image
+     * @param image receives the image
+     * @return an error message, or nullptr on success
+     */
+    const char* decodeRequest(const std::vector<uchar>& data, cv::Mat& buffer, cv::Mat& image) {
+        if(data.empty())
+            return "empty request";
+
+        if(data[0] == KIND_ENCODED) {
+            buffer = cv::imdecode(cv::Mat(1, static_cast<int>(data.size() - 1), CV_8UC1, const_cast<uchar*>(data.data() + 1)), cv::IMREAD_COLOR);
+            image = buffer;
+            return image.empty() ? "image could not be decoded" : nullptr;
+        }
+
+        if(data[0] != KIND_RAW)
+            return "unknown request kind";
+        if(data.size() < 14)
+            return "truncated frame header";
+
+        const uint32_t width = readUInt32(&data[1]), height = readUInt32(&data[5]), stride = readUInt32(&data[9]);
+        const uchar format = data[13];
+        if(format > ImageView::FORMAT_UYVY)
+            return "unknown pixel format";
+
+        const size_t pixelSize = (format == ImageView::FORMAT_BGR) ? 3 : (format >= ImageView::FORMAT_YUYV) ? 2 : 1;
+        if(width == 0 || height == 0 || width > 65535 || height > 65535 || stride < width * pixelSize)
+            return "invalid frame size";
+        if(data.size() - 14 < static_cast<size_t>(stride) * (height - 1) + width * pixelSize)
+            return "truncated frame";
+
+        ImageView view(data.data() + 14, static_cast<int>(width), static_cast<int>(height), stride, static_cast<ImageView::Format>(format));
+        image = view.toMat(buffer);
+        return nullptr;
+    }
+
+    /**
+     * Helper function, detecting and decoding the code of a request.
+     * @param id the id of the request
+     * @param image the image of the request
+     * @param detector the detector of the calling thread
+     * @param context the buffers of the calling thread
+     * @param stats the statistics of the context, being reset
+     * @param decoder the decoder of the calling thread
+     * @param tryScaling whether to search the rescaled image, in case no code has been found
+     * @return the response line
+     */
+    std::string detectResponse(size_t id, const cv::Mat& image, const QRDetector& detector, QRDetectorContext& context,
+                               QRDetector::Stats& stats, const QRDecoder& decoder, bool tryScaling) {
+
+        // Locate in full resolution first, which yields the corners as well. On a miss,
+        // only the other scales are searched, the full resolution has been done already.
+        stats.reset();
+        int64 start = cv::getTickCount();
+        QRDetector::QRCode code;
+        cv::Mat grid;
+        int numMarkers = 0;
+        const std::vector<QRDetector::QRCode>& codes = detector.locateQRCodes(image, context, QRDetector::DEBUG_NONE, &numMarkers);
+        if(!codes.empty()) {
+            code = codes.front();
+            grid = detector.sampleQRCode(image, code, context);
+        }
+        const bool located = !grid.empty();
+        if(!located && tryScaling)
+            grid = detector.detectQRCodeRescaled(image, numMarkers, context);
+        double milliseconds = (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+        std::ostringstream line;
+        line << "{\"id\": " << id << ", \"found\": " << (grid.empty() ? "false" : "true");
+        if(!grid.empty()) {
+            std::string modules(grid.total(), '0');
+            for(int r = 0; r < grid.rows; r++) {
+                const uchar* row = grid.ptr(r);
+                for(int c = 0; c < grid.cols; c++)
+                    modules[r * grid.cols + c] = (row[c] < 128) ? '1' : '0';
+            }
+            line << ", \"size\": " << grid.rows << ", \"grid\": \"" << modules << "\"";
+            if(located) {
+                line << ", \"corners\": [[" << code.a.x << ", " << code.a.y << "], [" << code.b.x << ", " << code.b.y
+                     << "], [" << code.c.x << ", " << code.c.y << "], [" << code.d.x << ", " << code.d.y << "]]";
+            }
+
+            QRDecoder::Result decoded = decoder.decode(grid);
+            if(decoded.status == QRDecoder::STATUS_OK)
+                line << ", \"payload\": " << quoteJson(decoded.payload);
+        }
+        line << ", \"ms\": " << milliseconds << ", \"stages_ms\": {";
+        for(int s = 0; s < QRDetector::STAGE_COUNT; s++)
+            line << (s ? ", " : "") << quoteJson(QRDetector::Stats::stageName(static_cast<QRDetector::Stage>(s))) << ": " << stats.milliseconds[s];
+        line << "}}\n";
+        return line.str();
+    }
+}
+
+DetectionServer::Options::Options()
+    : workers(std::max(1u, std::thread::hardware_concurrency()))
+    , tryScaling(true)
+{
+}
+
+DetectionServer::DetectionServer(const Options& options)
+    : options_(options)
+{
+    options_.workers = std::max(1, options_.workers);
+}
+
+bool DetectionServer::serve(int inFd, int outFd) const {
+
+    // We parallelize over requests, so OpenCV only provides the threads for tiling, if requested.
+    int numThreads = cv::getNumThreads();
+    cv::setNumThreads(options_.detector.threads());
+
+    BoundedQueue<Request> requests(QUEUE_SIZE_PER_THREAD * options_.workers);
+    BoundedQueue<Response> responses(QUEUE_SIZE_PER_THREAD * options_.workers);
+
+    // Stage 2: Detect the codes, each worker owning its own detector and buffers.
+    std::atomic<int> activeWorkers(options_.workers);
+    std::vector<std::thread> workers;
+    for(int t = 0; t < options_.workers; t++) {
+        workers.emplace_back([&] {
+            QRDetector detector = options_.detector;
+            QRDetectorContext context;
+            QRDetector::Stats stats;
+            QRDecoder decoder;
+            cv::Mat buffer, image;
+            context.setStats(&stats);
+
+            Request request;
+            while(requests.pop(request)) {
+                Response response;
+                response.id = request.id;
+
+                // A single bad frame must not take down the whole server, so errors are answered.
+                try {
+                    const char* error = request.error ? request.error : decodeRequest(request.data, buffer, image);
+                    response.line = error ? errorResponse(request.id, error) : detectResponse(request.id, image, detector, context, stats, decoder, options_.tryScaling);
+                } catch(const std::exception& e) {
+                    response.line = errorResponse(request.id, e.what());
+                }
+                if(!responses.push(std::move(response)))
+                    break;
+            }
+            if(--activeWorkers == 0)
+                responses.close();
+        });
+    }
+
+    // Stage 3: Write the responses in the order of their requests.
+    bool writeFailed = false;
+    std::thread writer([&] {
+        std::map<size_t, std::string> pending;
+        size_t next = 0;
+        Response response;
+        while(responses.pop(response)) {
+            pending[response.id] = std::move(response.line);
+            for(auto it = pending.find(next); it != pending.end(); it = pending.find(next)) {
+                if(!writeFailed && !writeFully(outFd, it->second.data(), it->second.size()))
+                    writeFailed = true;
+                pending.erase(it);
+                next++;
+            }
+
+            // Nobody is listening anymore, so stop reading further requests.
+            if(writeFailed)
+                requests.close();
+        }
+    });
+
+    // Stage 1: Read the requests on the calling thread.
+    bool readFailed = false;
+    for(size_t id = 0; ; id++) {
+        uchar header[4];
+        if(!readFully(inFd, header, sizeof(header)))
+            break;
+
+        Request request;
+        request.id = id;
+        request.error = nullptr;
+        const uint32_t length = readUInt32(header);
+
+        // The stream cannot be resynchronized without reading the whole request, so it is
+        // answered by an error and the session ends.
+        if(length > MAX_REQUEST_SIZE) {
+            request.error = "request too large";
+            requests.push(std::move(request));
+            readFailed = true;
+            break;
+        }
+        request.data.resize(length);
+        if(!readFully(inFd, request.data.data(), length)) {
+            readFailed = true;
+            break;
+        }
+        if(!requests.push(std::move(request)))
+            break;
+    }
+    requests.close();
+
+    for(std::thread& thread : workers)
+        thread.join();
+    writer.join();
+
+    cv::setNumThreads(numThreads);
+
+    return !readFailed && !writeFailed;
+}
+
+bool DetectionServer::listen(const std::string& path) const {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path))
+        return false;
+    path.copy(address.sun_path, path.size());
+
+    int server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(server < 0)
+        return false;
+
+    ::unlink(path.c_str());
+    if(::bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(server, SOMAXCONN) != 0) {
+        ::close(server);
+        return false;
+    }
+
+    // Clients disconnecting early must not terminate the server.
+    ::signal(SIGPIPE, SIG_IGN);
+
+    while(true) {
+        int client = ::accept(server, nullptr, nullptr);
+        if(client < 0) {
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+
+        serve(client, client);
+        ::close(client);
+    }
+
+    ::close(server);
+    return false;
+}
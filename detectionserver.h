@@ -0,0 +1,73 @@
+#ifndef QR_CODE_DETECTIONSERVER_H
+#define QR_CODE_DETECTIONSERVER_H
+
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+#include "qrdetector.h"
+
+/**
+ * Long-running detection service, reading frames from a stream and answering each
+ * one with a line of JSON. A fixed pool of detection threads keeps its detectors
+ * and buffers warm over all requests. Requests of a stream are processed concurrently,
+ * but answered in order. Bounded queues between reading, detection and writing
+ * apply backpressure, such that a client sending faster than being served blocks.
+ *
+ * Each request is a 32 bit little endian length, followed by that many bytes:
+ *
+ *   uint8 kind     0 for an encoded image (PNG, JPEG, ...), 1 for a raw frame
+ *   raw frames:    uint32 width, uint32 height, uint32 stride, uint8 format (ImageView::Format),
+ *                  followed by the pixels, of which only the Y plane is needed for planar YUV
+ *   encoded image: the file contents
+ *
+ * Each response is a single line:
+ *
+ *   {"id": 0, "found": true, "size": 21, "grid": "1111111010...", "corners": [[x, y], ...],
+ *    "payload": "...", "ms": 3.2, "stages_ms": {"preprocess": 1.1, ...}}
+ *
+ * where the grid lists the modules row by row, 1 being dark. Corners are given in the
+ * order a, b, c, d, unless the code has only been found on a rescaled image. Payload
+ * bytes outside of printable ASCII are escaped as \u00XX. Malformed requests and frames
+ * the detector fails on are answered by {"id": n, "error": "..."}. So are requests
+ * exceeding the max. size, which end the session.
+ */
+class DetectionServer {
+
+    // Max. size of a single request.
+    static constexpr size_t MAX_REQUEST_SIZE = 64 * 1024 * 1024;
+
+public:
+
+    struct Options {
+        int workers;         // Number of detection threads.
+        bool tryScaling;     // Retry on a rescaled image, in case no code has been found.
+        QRDetector detector; // Configured detector, being copied for each thread.
+        Options();
+    };
+
+    explicit DetectionServer(const Options& options = Options());
+
+    /**
+     * Serves the requests of a single stream, until it is closed by the client.
+     * @param inFd the file descriptor to read requests from
+     * @param outFd the file descriptor to write responses to
+     * @return false, if the stream has been interrupted by an error
+     */
+    bool serve(int inFd, int outFd) const;
+
+    /**
+     * Listens on a Unix domain socket, serving one connection after the other.
+     * Only returns, if the socket could not be set up.
+     * @param path the path of the socket, an existing file is replaced
+     * @return false, if the socket could not be set up
+     */
+    bool listen(const std::string& path) const;
+
+private:
+
+    Options options_;
+};
+
+
+#endif //QR_CODE_DETECTIONSERVER_H
@@ -0,0 +1,240 @@
+#include "finderscanner.h"
+
+#include <cstring>
+
+void FinderScanner::findCenters(const cv::Mat& binary, std::vector<Center>& centers) const {
+    assert(binary.type() == CV_8UC1);
+
+    centers.clear();
+
+    // Scan all rows and columns.
+    for(int y = 0; y < binary.rows; y++)
+        scanLine(binary, cv::Point(0, y), cv::Point(1, 0), &centers);
+    for(int x = 0; x < binary.cols; x++)
+        scanLine(binary, cv::Point(x, 0), cv::Point(0, 1), &centers);
+
+    // Only keep patterns being seen multiple times.
+    centers.erase(std::remove_if(centers.begin(), centers.end(),
+                                 [](const Center& center) { return center.count < MIN_CONFIRMATIONS; }),
+                  centers.end());
+}
+
+int FinderScanner::countRuns(const cv::Mat& binary, int maxRuns) {
+    assert(binary.type() == CV_8UC1);
+
+    // Lines without any dark pixel cannot hold a run, which skips most of a blank image.
+    cv::reduce(binary, columnMin_, 0, CV_REDUCE_MIN);
+    const uchar* columns = columnMin_.ptr();
+
+    int runs = 0;
+    for(int y = 0; y < binary.rows && runs < maxRuns; y++) {
+        if(std::memchr(binary.ptr(y), 0, binary.cols))
+            runs += scanLine(binary, cv::Point(0, y), cv::Point(1, 0), nullptr);
+    }
+    for(int x = 0; x < binary.cols && runs < maxRuns; x++) {
+        if(columns[x] == 0)
+            runs += scanLine(binary, cv::Point(x, 0), cv::Point(0, 1), nullptr);
+    }
+    return runs;
+}
+
+void FinderScanner::extractContours(const cv::Mat& binary, const std::vector<Center>& centers, std::vector<std::vector<cv::Point>>& patterns) {
+    // Contours already stored keep their capacity, when being overwritten.
+    size_t count = 0;
+
+    for(const Center& center : centers) {
+
+        // Crop a region, which is large enough to contain the pattern in any rotation.
+        int radius = static_cast<int>(std::ceil(CONTOUR_RADIUS * center.moduleSize)) + 2;
+        cv::Rect roi(static_cast<int>(center.position.x) - radius, static_cast<int>(center.position.y) - radius, 2 * radius + 1, 2 * radius + 1);
+        roi &= cv::Rect(0, 0, binary.cols, binary.rows);
+
+        // The outer ring is dark and separated from the surrounding by light modules.
+        cv::threshold(binary(roi), region_, 0, 255, cv::THRESH_BINARY_INV);
+        cv::findContours(region_, contours_, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE, roi.tl());
+
+        // Take the smallest contour enclosing the center.
+        int best = -1;
+        double bestArea = 0.0;
+        for(int i = 0; i < contours_.size(); i++) {
+            if(cv::pointPolygonTest(contours_[i], center.position, false) < 0)
+                continue;
+
+            double area = cv::contourArea(contours_[i]);
+            if(best < 0 || area < bestArea) {
+                best = i;
+                bestArea = area;
+            }
+        }
+        if(best < 0)
+            continue;
+
+        // Discard contours, which have been merged with their surrounding.
+        double expected = 49.0 * center.moduleSize * center.moduleSize; // 7x7 modules
+        if(bestArea > 2.0 * expected || bestArea < 0.5 * expected)
+            continue;
+
+        if(count == patterns.size())
+            patterns.emplace_back();
+        patterns[count++] = contours_[best];
+    }
+    patterns.resize(count);
+}
+
+int FinderScanner::scanLine(const cv::Mat& binary, const cv::Point& origin, const cv::Point& dir, std::vector<Center>* centers) const {
+    const int length = (dir.x != 0) ? binary.cols : binary.rows;
+    const uchar* data = binary.ptr(origin.y) + origin.x;
+    const size_t step = (dir.x != 0) ? 1 : binary.step;
+
+    // Runs of dark, light, dark, light, dark pixels.
+    int counts[5] = {0};
+    int state = 0, runs = 0;
+    for(int i = 0; i <= length; i++) {
+        bool dark = (i < length) && (data[i * step] == 0);
+
+        if(dark) {
+            // Light to dark transition, continue with the next run.
+            if(state & 1)
+                state++;
+            counts[state]++;
+        } else if(state & 1) {
+            counts[state]++;
+        } else if(state < 4) {
+            // Dark to light transition, continue with the next run.
+            state++;
+            counts[state]++;
+        } else {
+            // All five runs are complete.
+            if(checkRatio(counts)) {
+                runs++;
+                if(centers) {
+                    float center = i - counts[4] - counts[3] - counts[2] / 2.0f - 0.5f;
+                    handlePattern(binary, cv::Point2f(origin.x + dir.x * center, origin.y + dir.y * center), dir,
+                                  counts[0] + counts[1] + counts[2] + counts[3] + counts[4], *centers);
+                }
+            }
+
+            // Move on by two runs, the current one being light.
+            counts[0] = counts[2];
+            counts[1] = counts[3];
+            counts[2] = counts[4];
+            counts[3] = 1;
+            counts[4] = 0;
+            state = 3;
+        }
+    }
+    return runs;
+}
+
+void FinderScanner::handlePattern(const cv::Mat& binary, cv::Point2f position, const cv::Point& dir, int total, std::vector<Center>& centers) const {
+    const cv::Point across(dir.y, dir.x);
+    cv::Point2f diagonal;
+    int acrossTotal, alongTotal, diagonalTotal;
+
+    // Cross check perpendicular, which refines the position in that direction.
+    if(!crossCheck(binary, position, across, total, position, acrossTotal))
+        return;
+
+    // Check again along the scan line, refining the position there.
+    if(!crossCheck(binary, position, dir, total, position, alongTotal))
+        return;
+
+    // Finally, the diagonals need to show the same pattern.
+    if(!crossCheck(binary, position, cv::Point(1, 1), 2 * total, diagonal, diagonalTotal) ||
+       !crossCheck(binary, position, cv::Point(1, -1), 2 * total, diagonal, diagonalTotal))
+        return;
+
+    // Sizes in both directions may only differ by rotation or perspective.
+    float ratio = static_cast<float>(std::max(acrossTotal, alongTotal)) / std::min(acrossTotal, alongTotal);
+    if(ratio > MAX_SIZE_RATIO)
+        return;
+
+    float moduleSize = (acrossTotal + alongTotal) / 14.0f; // 7 modules, 2 directions
+
+    // Merge with a pattern already found.
+    for(Center& center : centers) {
+        cv::Point2f d = center.position - position;
+        if(std::abs(d.x) <= center.moduleSize && std::abs(d.y) <= center.moduleSize &&
+           std::abs(center.moduleSize - moduleSize) <= std::max(1.0f, 0.5f * center.moduleSize)) {
+            float weight = 1.0f / (center.count + 1);
+            center.position = center.position * (1.0f - weight) + position * weight;
+            center.moduleSize = center.moduleSize * (1.0f - weight) + moduleSize * weight;
+            center.count++;
+            return;
+        }
+    }
+
+    Center center = {position, moduleSize, 1};
+    centers.push_back(center);
+}
+
+bool FinderScanner::crossCheck(const cv::Mat& binary, const cv::Point2f& center, const cv::Point& dir, int maxCount, cv::Point2f& refined, int& total) const {
+    const int cx = cvRound(center.x), cy = cvRound(center.y);
+
+    // Returns 1 for dark, 0 for light pixels and -1 outside the image.
+    auto pixel = [&](int i) -> int {
+        int x = cx + i * dir.x, y = cy + i * dir.y;
+        if(x < 0 || y < 0 || x >= binary.cols || y >= binary.rows)
+            return -1;
+        return binary.at<uchar>(y, x) == 0 ? 1 : 0;
+    };
+
+    int counts[5] = {0};
+
+    // Move backwards, starting inside the center run.
+    int i = 0;
+    while(pixel(-i) == 1) { counts[2]++; i++; }
+    if(counts[2] == 0)
+        return false;
+    while(pixel(-i) == 0 && counts[1] <= maxCount) { counts[1]++; i++; }
+    if(pixel(-i) != 1 || counts[1] > maxCount)
+        return false;
+    while(pixel(-i) == 1 && counts[0] <= maxCount) { counts[0]++; i++; }
+    if(counts[0] > maxCount)
+        return false;
+
+    // Move forwards.
+    i = 1;
+    while(pixel(i) == 1) { counts[2]++; i++; }
+    const int centerEnd = i;
+    while(pixel(i) == 0 && counts[3] <= maxCount) { counts[3]++; i++; }
+    if(pixel(i) != 1 || counts[3] > maxCount)
+        return false;
+    while(pixel(i) == 1 && counts[4] <= maxCount) { counts[4]++; i++; }
+    if(counts[4] > maxCount)
+        return false;
+
+    if(!checkRatio(counts))
+        return false;
+
+    // Move the center into the middle of the center run.
+    float offset = centerEnd - counts[2] / 2.0f - 0.5f;
+    cv::Point2f result = center;
+    if(dir.x)
+        result.x = cx + dir.x * offset;
+    if(dir.y)
+        result.y = cy + dir.y * offset;
+
+    refined = result;
+    total = counts[0] + counts[1] + counts[2] + counts[3] + counts[4];
+    return true;
+}
+
+bool FinderScanner::checkRatio(const int counts[5]) {
+    int total = 0;
+    for(int i = 0; i < 5; i++) {
+        if(counts[i] == 0)
+            return false;
+        total += counts[i];
+    }
+    if(total < 7)
+        return false;
+
+    float moduleSize = total / 7.0f;
+    float maxVariance = moduleSize * MAX_VARIANCE;
+    return std::abs(moduleSize - counts[0]) < maxVariance &&
+           std::abs(moduleSize - counts[1]) < maxVariance &&
+           std::abs(3.0f * moduleSize - counts[2]) < 3.0f * maxVariance &&
+           std::abs(moduleSize - counts[3]) < maxVariance &&
+           std::abs(moduleSize - counts[4]) < maxVariance;
+}
@@ -0,0 +1,81 @@
+#ifndef QR_CODE_FINDERSCANNER_H
+#define QR_CODE_FINDERSCANNER_H
+
+#include <opencv2/opencv.hpp>
+
+#include <climits>
+
+/**
+ * Locates finder patterns by scanning rows and columns of a binary image for
+ * runs in the ratio 1:1:3:1:1, as an alternative to the contour hierarchy.
+ * Each hit is cross checked perpendicular and diagonal to the scan direction.
+ * The scanner keeps its buffers between calls, so it should be reused.
+ */
+class FinderScanner {
+
+    // Max. deviation of a run from its expected length, relative to the module size.
+    static constexpr float MAX_VARIANCE = 0.5f;
+
+    // Number of scan lines, which need to confirm a pattern.
+    static constexpr int MIN_CONFIRMATIONS = 2;
+
+    // Max. ratio between the pattern sizes found along different directions.
+    static constexpr float MAX_SIZE_RATIO = 2.0f;
+
+    // Radius of the region used to extract the pattern's contour, in modules.
+    static constexpr float CONTOUR_RADIUS = 6.0f;
+
+public:
+
+    // A pattern's center, as seen by the scan lines.
+    struct Center {
+        cv::Point2f position;
+        float moduleSize;
+        int count;
+    };
+
+    /**
+     * Finds all pattern centers inside a binary image.
+     * @param binary the binary image, dark pixels being 0
+     * @param centers receives the pattern centers, confirmed by multiple scan lines
+     */
+    void findCenters(const cv::Mat& binary, std::vector<Center>& centers) const;
+
+    /**
+     * Counts the runs in the ratio 1:1:3:1:1 along all rows and columns, without
+     * cross checking them. Serves as cheap indicator, whether patterns are present.
+     * Rows and columns without any dark pixel are skipped.
+     * @param binary the binary image, dark pixels being 0
+     * @param maxRuns stops counting, once this number of runs has been reached
+     * @return the number of runs, at most maxRuns unless a single line exceeds it
+     */
+    int countRuns(const cv::Mat& binary, int maxRuns = INT_MAX);
+
+    /**
+     * Extracts the outer contour of each pattern, as consumed by the QR detector.
+     * @param binary the binary image, dark pixels being 0
+     * @param centers the pattern centers
+     * @param patterns receives the outer contour of each pattern
+     */
+    void extractContours(const cv::Mat& binary, const std::vector<Center>& centers, std::vector<std::vector<cv::Point>>& patterns);
+
+private:
+
+    //! @brief Scans a single line for patterns, starting at origin and moving along dir. Returns the number of runs, adding them to centers if given.
+    int scanLine(const cv::Mat& binary, const cv::Point& origin, const cv::Point& dir, std::vector<Center>* centers) const;
+
+    //! @brief Verifies a pattern found at the given position and adds it to the centers.
+    void handlePattern(const cv::Mat& binary, cv::Point2f position, const cv::Point& dir, int total, std::vector<Center>& centers) const;
+
+    //! @brief Measures the pattern along dir through center, returning its refined center and size.
+    bool crossCheck(const cv::Mat& binary, const cv::Point2f& center, const cv::Point& dir, int maxCount, cv::Point2f& refined, int& total) const;
+
+    //! @brief Checks whether the runs match the ratio 1:1:3:1:1.
+    static bool checkRatio(const int counts[5]);
+
+    cv::Mat region_, columnMin_;
+    std::vector<std::vector<cv::Point>> contours_;
+};
+
+
+#endif //QR_CODE_FINDERSCANNER_H
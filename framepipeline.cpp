@@ -0,0 +1,190 @@
+#include "framepipeline.h"
+
+#include <algorithm>
+
+#include "qrutils.h"
+
+FramePipeline::Options::Options()
+    : workers(static_cast<int>(std::max(2u, std::thread::hardware_concurrency()) - 1))
+    , tryScaling(true)
+{
+}
+
+FramePipeline::FramePipeline(const Options& options)
+    : options_(options)
+    , slotTicks_(0)
+    , slotFrame_(0)
+    , slotFull_(false)
+    , capturing_(false)
+    , stopping_(false)
+    , taken_(0)
+    , stats_()
+    , nextResult_(0)
+    , activeWorkers_(0)
+    , numThreads_(0)
+{
+    options_.workers = std::max(1, options_.workers);
+}
+
+FramePipeline::~FramePipeline() {
+    stop();
+}
+
+bool FramePipeline::start(cv::VideoCapture& capture) {
+    if(!capture.isOpened() || captureThread_.joinable())
+        return false;
+
+    slot_.release();
+    slotFull_ = false;
+    capturing_ = true;
+    stopping_ = false;
+    taken_ = 0;
+    stats_ = Stats();
+    pending_.clear();
+    nextResult_ = 0;
+    activeWorkers_ = options_.workers;
+
+    // We parallelize over frames, so OpenCV only provides the threads for tiling, if requested.
+    numThreads_ = cv::getNumThreads();
+    cv::setNumThreads(options_.detector.threads());
+
+    captureThread_ = std::thread(&FramePipeline::capture, this, std::ref(capture));
+    for(int t = 0; t < options_.workers; t++)
+        workers_.emplace_back(&FramePipeline::detect, this);
+    return true;
+}
+
+bool FramePipeline::next(Result& result) {
+    int64 captured;
+    {
+        std::unique_lock<std::mutex> lock(resultMutex_);
+        resultReady_.wait(lock, [this] { return pending_.count(nextResult_) || activeWorkers_ == 0; });
+        auto it = pending_.find(nextResult_);
+        if(it == pending_.end())
+            return false;
+
+        result = std::move(it->second.result);
+        captured = it->second.captured;
+        pending_.erase(it);
+        nextResult_++;
+    }
+    result.milliseconds = (cv::getTickCount() - captured) * 1000.0 / cv::getTickFrequency();
+
+    {
+        std::lock_guard<std::mutex> lock(slotMutex_);
+        stats_.delivered++;
+        stats_.meanMilliseconds += (result.milliseconds - stats_.meanMilliseconds) / stats_.delivered;
+        stats_.maxMilliseconds = std::max(stats_.maxMilliseconds, result.milliseconds);
+    }
+
+    // A worker may be waiting for a result to be delivered, before taking the next frame.
+    slotReady_.notify_all();
+    return true;
+}
+
+void FramePipeline::stop() {
+    {
+        std::lock_guard<std::mutex> lock(slotMutex_);
+        stopping_ = true;
+    }
+    slotReady_.notify_all();
+
+    if(captureThread_.joinable())
+        captureThread_.join();
+    for(std::thread& worker : workers_)
+        worker.join();
+    workers_.clear();
+
+    // Restore OpenCV's threads once, even if not all threads could be started.
+    if(numThreads_ > 0) {
+        cv::setNumThreads(numThreads_);
+        numThreads_ = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(resultMutex_);
+    pending_.clear();
+}
+
+FramePipeline::Stats FramePipeline::stats() const {
+    std::lock_guard<std::mutex> lock(slotMutex_);
+    return stats_;
+}
+
+void FramePipeline::capture(cv::VideoCapture& capture) {
+    for(size_t frame = 0; ; frame++) {
+        {
+            std::lock_guard<std::mutex> lock(slotMutex_);
+            if(stopping_)
+                break;
+        }
+
+        // Each frame gets a buffer of its own, as the previous one may still be processed.
+        cv::Mat image;
+        if(!capture.read(image) || image.empty())
+            break;
+        const int64 ticks = cv::getTickCount();
+
+        // Latest frame wins, replacing the one in the slot if no worker has been idle.
+        {
+            std::lock_guard<std::mutex> lock(slotMutex_);
+            stats_.captured++;
+            if(slotFull_)
+                stats_.dropped++;
+            slot_ = image;
+            slotTicks_ = ticks;
+            slotFrame_ = frame;
+            slotFull_ = true;
+        }
+        slotReady_.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(slotMutex_);
+        capturing_ = false;
+    }
+    slotReady_.notify_all();
+}
+
+void FramePipeline::detect() {
+
+    // Debug windows may only be shown by the main thread, so none are requested here.
+    QRDetector detector = options_.detector;
+    QRDetectorContext context;
+    while(true) {
+        Pending item;
+        size_t ticket;
+        {
+            // Take the latest frame only while fewer results than workers await delivery. As long as the
+            // consumer lags behind, the capture keeps replacing the frame, so pending_ stays bounded.
+            std::unique_lock<std::mutex> lock(slotMutex_);
+            slotReady_.wait(lock, [this] {
+                return stopping_ || (slotFull_ ? taken_ - stats_.delivered < static_cast<size_t>(options_.workers) : !capturing_);
+            });
+            if(stopping_ || !slotFull_)
+                break;
+
+            item.result.image = slot_;
+            item.result.frame = slotFrame_;
+            item.captured = slotTicks_;
+            slot_.release();
+            slotFull_ = false;
+            ticket = taken_++;
+        }
+
+        // The code is handed over to the consumer, so it may not share the context's buffers.
+        item.result.code = detectWithScaling(detector, item.result.image, options_.tryScaling, context).clone();
+        item.result.milliseconds = 0.0;
+
+        {
+            std::lock_guard<std::mutex> lock(resultMutex_);
+            pending_[ticket] = std::move(item);
+        }
+        resultReady_.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(resultMutex_);
+        activeWorkers_--;
+    }
+    resultReady_.notify_all();
+}
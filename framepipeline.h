@@ -0,0 +1,117 @@
+#ifndef QR_CODE_FRAMEPIPELINE_H
+#define QR_CODE_FRAMEPIPELINE_H
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "qrdetector.h"
+
+/**
+ * Runs the detector on a live camera, capturing and detecting on separate threads.
+ * The capture thread keeps only the latest frame in a single slot, replacing any
+ * frame no worker has taken yet, such that detection never falls behind the camera
+ * by more than the frames being processed. A pool of detection threads takes the
+ * latest frame whenever one becomes idle and fewer results than workers await
+ * delivery. Results are delivered in the order their frames have been captured,
+ * along with the time from capture to delivery.
+ */
+class FramePipeline {
+public:
+
+    struct Options {
+        int workers;         // Number of detection threads.
+        bool tryScaling;     // Retry on a rescaled image, in case no code has been found.
+        QRDetector detector; // Configured detector, being copied for each thread.
+        Options();
+    };
+
+    struct Result {
+        size_t frame;        // Number of the frame, counting all captured frames including the dropped ones.
+        cv::Mat image;       // The captured frame.
+        cv::Mat code;        // The normalized code, or an empty matrix.
+        double milliseconds; // Time from capturing the frame to delivering the result.
+    };
+
+    // Statistics since the pipeline has been started.
+    struct Stats {
+        size_t captured;         // Frames read from the camera.
+        size_t dropped;          // Frames replaced by a newer one, before any worker took them.
+        size_t delivered;        // Results delivered.
+        double meanMilliseconds; // Mean time from capture to delivery.
+        double maxMilliseconds;  // Max. time from capture to delivery.
+    };
+
+    explicit FramePipeline(const Options& options = Options());
+
+    //! @brief Stops the pipeline, if still running.
+    ~FramePipeline();
+
+    /**
+     * Starts capturing and detecting. The capture must stay open, until the pipeline is stopped.
+     * @param capture the opened camera
+     * @return false, if the camera is not opened or the pipeline is running already
+     */
+    bool start(cv::VideoCapture& capture);
+
+    /**
+     * Waits for the result of the next frame being processed.
+     * @param result receives the result
+     * @return false, if the pipeline has been stopped or the camera has no more frames
+     */
+    bool next(Result& result);
+
+    //! @brief Stops capturing and waits for all threads, results not delivered yet are discarded.
+    void stop();
+
+    //! @brief Returns the statistics gathered so far.
+    Stats stats() const;
+
+private:
+
+    //! @brief Reads frames into the slot, until being stopped or the camera fails.
+    void capture(cv::VideoCapture& capture);
+
+    //! @brief Detects the code in the latest frame, until being stopped.
+    void detect();
+
+    Options options_;
+    std::thread captureThread_;
+    std::vector<std::thread> workers_;
+
+    // Latest frame, guarded by slotMutex_.
+    mutable std::mutex slotMutex_;
+    std::condition_variable slotReady_;
+    cv::Mat slot_;
+    int64 slotTicks_;
+    size_t slotFrame_;
+    bool slotFull_;
+    bool capturing_;
+    bool stopping_;
+    size_t taken_;
+    Stats stats_;
+
+    // A result waiting to be delivered, along with the time its frame has been captured.
+    struct Pending {
+        Result result;
+        int64 captured;
+    };
+
+    // Results waiting to be delivered in the order their frames have been taken, guarded by resultMutex_.
+    // Holds at most one result per worker, as workers wait for delivery before taking further frames.
+    std::mutex resultMutex_;
+    std::condition_variable resultReady_;
+    std::map<size_t, Pending> pending_;
+    size_t nextResult_;
+    int activeWorkers_;
+
+    // Threads of OpenCV before the pipeline has been started, being restored when stopped, or 0 if none are saved.
+    int numThreads_;
+};
+
+
+#endif //QR_CODE_FRAMEPIPELINE_H
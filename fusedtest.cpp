@@ -0,0 +1,131 @@
+#include <opencv2/opencv.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "binarization.h"
+
+//////////////////////////////////////////////////////
+/// Constants definition section
+///
+static const char* DEFAULT_IMAGES = "tests/images";
+static const int WIDTHS[] = {1, 2, 3, 4, 15, 16, 17, 31, 32, 33, 47, 63, 65, 100};
+static const int HEIGHTS[] = {1, 2, 3, 29};
+//////////////////////////////////////////////////////
+
+namespace {
+
+    /**
+     * Helper function, creating a synthetic image of dark and light blocks under an uneven
+     * illumination, overlaid by noise, such that each pixel's neighbourhood differs.
+     * @param size the image size
+     * @param type CV_8UC1 or CV_8UC3
+     * @param seed the seed of the noise
+     * @return the image
+     */
+    cv::Mat syntheticImage(const cv::Size& size, int type, uint32_t seed) {
+        cv::Mat image(size, type);
+        const int channels = image.channels();
+        for(int y = 0; y < size.height; y++) {
+            uchar* row = image.ptr(y);
+            for(int x = 0; x < size.width; x++) {
+                const int light = 60 + 140 * (x + y) / (size.width + size.height);
+                const bool dark = ((x / 3) ^ (y / 2)) & 1;
+                for(int c = 0; c < channels; c++) {
+                    seed = seed * 1664525u + 1013904223u;
+                    const int noise = static_cast<int>(seed >> 26) - 32;
+                    row[x * channels + c] = cv::saturate_cast<uchar>((dark ? light / 3 : light) + noise + 20 * c);
+                }
+            }
+        }
+        return image;
+    }
+
+    //! @brief Helper function, binarizing by the chain of OpenCV calls being reproduced by fusedBinarize.
+    void referenceBinarize(const cv::Mat& image, cv::Mat& binary) {
+        if(image.channels() == 1) {
+            cv::medianBlur(image, binary, 3);
+        } else {
+            cv::cvtColor(image, binary, CV_RGB2GRAY);
+            cv::medianBlur(binary, binary, 3);
+        }
+        cv::threshold(binary, binary, 0, 255, cv::THRESH_OTSU);
+        cv::medianBlur(binary, binary, 3);
+    }
+
+    /**
+     * Helper function, comparing fusedBinarize with the chain of OpenCV calls.
+     * @param label the name of the check being printed on failure
+     * @param image the CV_8UC3 or CV_8UC1 input image
+     * @param buffer working memory, shared between all checks
+     * @return true, if both agree on every pixel
+     */
+    bool check(const std::string& label, const cv::Mat& image, std::vector<uchar>& buffer) {
+        cv::Mat fused, reference;
+        fusedBinarize(image, fused, buffer);
+        referenceBinarize(image, reference);
+
+        const int differences = cv::countNonZero(fused != reference);
+        if(differences != 0) {
+            std::cout << "FAILED " << label << ": " << differences << " pixels differ" << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+/**
+ * Regression check of fusedBinarize, which has to be bit-identical to converting into
+ * grayscale, median filtering, thresholding by Otsu's method and median filtering again.
+ * Covers grayscale and color images of all widths around the vector sizes, regions of
+ * larger images whose rows are not continuous, as well as the images of tests/images.
+ * Run from the source directory, or pass the image directory.
+ */
+int main(int argc, char** argv) {
+    std::string imageDir = (argc > 1) ? argv[1] : DEFAULT_IMAGES;
+
+    int failures = 0, checks = 0;
+    std::vector<uchar> buffer;
+    for(int width : WIDTHS) {
+        for(int height : HEIGHTS) {
+            for(int type : {CV_8UC1, CV_8UC3}) {
+                std::ostringstream label;
+                label << width << "x" << height << (type == CV_8UC1 ? " gray" : " color");
+
+                const cv::Mat image = syntheticImage(cv::Size(width, height), type, static_cast<uint32_t>(width * 131 + height + type));
+                failures += !check(label.str(), image, buffer);
+
+                // A region inside a larger image, whose rows are not continuous.
+                const cv::Mat larger = syntheticImage(cv::Size(width + 5, height + 4), type, static_cast<uint32_t>(width + height * 131 + type));
+                failures += !check(label.str() + " region", larger(cv::Rect(2, 1, width, height)), buffer);
+                checks += 2;
+            }
+        }
+    }
+
+    std::vector<cv::String> files;
+    cv::glob(imageDir + "/*.jpg", files, false);
+    for(const cv::String& file : files) {
+        cv::Mat image = cv::imread(file), gray;
+        if(image.empty()) {
+            std::cout << "FAILED " << file << ": cannot load the image" << std::endl;
+            failures++;
+            continue;
+        }
+        cv::cvtColor(image, gray, CV_RGB2GRAY);
+        failures += !check(file + " color", image, buffer);
+        failures += !check(file + " gray", gray, buffer);
+        checks += 2;
+    }
+    if(files.empty()) {
+        std::cout << "FAILED " << imageDir << ": no images found" << std::endl;
+        failures++;
+    }
+
+    std::cout << checks - failures << "/" << checks << " binarizations match" << std::endl;
+    std::cout << (failures ? "Fused binarization regression failed." : "Fused binarization regression passed.") << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
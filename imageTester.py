@@ -1,5 +1,5 @@
 #!/usr/bin/env python3
-import os, glob, shutil, subprocess
+import os, glob, shutil, subprocess, sys
 
 ''' 
 *** Benoetigte Ordner werden vom Skript erstellt und der results/diffs/errors Ordner werden vor der Ausfuehrung geleert
@@ -8,53 +8,64 @@ import os, glob, shutil, subprocess
 *** Die Differenzbilder werden in Ordner diffs gespeichert und haben den gleichen Namen wie das getestete Bild
 *** Die erzeugten QR-Codes werden im Ordner results gespeichert und haben den gleichen Namen wie das getestete Bild
 *** Bilder, auf welchen kein QR-Code erkannt wurden werden im Ordner errors abgelegt
+*** Erkannte QR-Codes ohne Referenzbild und nicht ladbare Bilder werden getrennt gezaehlt
 *** Die Referenzbilder muessen im Ordner references liegen
 '''
 
 executable = 'qr_detector'
-diffName = 'diff.png'
+summaryName = 'summary.txt'
 baseDir = 'tests'
 
 dirs = {'ref':'references', 'res':'results', 'img':'images', 'err':'errors', 'dif':'diffs'}
 
 def testImages():
-    testImageRegex = os.path.join(baseDir, dirs['img'], '*.jpg')
-    testImages = glob.glob(testImageRegex)
+    imgDir = os.path.join(baseDir, dirs['img'])
+    resDir = os.path.join(baseDir, dirs['res'])
+    refDir = os.path.join(baseDir, dirs['ref'])
 
-    stats = { 'all' : len(testImages) }
+    # Alle Bilder werden in einem einzigen Prozess verarbeitet
+    # Weitere Argumente (z.B. --backend=scanline) werden an den Detektor weitergereicht
+    subprocess.call(['./' + executable] + sys.argv[1:] + ['--batch', imgDir, resDir, refDir])
+
+    stats = { 'all' : 0 }
     stats['notFound'] = 0
     stats['correct'] = 0
     stats['failed'] = 0
+    stats['found'] = 0
+    stats['loadFailed'] = 0
+
+    with open(os.path.join(resDir, summaryName)) as summary:
+        for line in summary:
+            if line.startswith('#'):
+                continue
+
+            img, status = line.split('\t')[:2]
+            path, name = os.path.split(img)
+            stem = name[:name.rfind('.')]
+            stats['all'] += 1
+
+            if status == 'correct':
+                stats['correct'] += 1
+
+            elif status == 'partial': # Diff file exists
+                stats['failed'] += 1
+                diffPath = os.path.join(baseDir, dirs['dif'], stem + '.png')
+                shutil.move(os.path.join(resDir, stem + '_diff.png'), diffPath)
+
+            elif status == 'found': # No reference to compare with
+                stats['found'] += 1
+
+            elif status == 'notfound':
+                stats['notFound'] += 1
+                errPath = os.path.join(baseDir, dirs['err'], name)
+                shutil.copyfile(img, errPath)
+
+            elif status == 'loadfailed': # Nothing to be copied
+                stats['loadFailed'] += 1
+
+            else:
+                raise ValueError('Unbekannter Status %s in %s' %(status, summaryName))
 
-    for img in testImages:
-        path, name = os.path.split(img)
-        
-        res = os.path.join(baseDir, dirs['res'], name)
-        
-        refName = name[:name.rfind('_')] + '.png'
-        ref = os.path.join(baseDir, dirs['ref'], refName)
-        
-        print("------------------- " + img + " -------------------")
-        resCode = subprocess.call(['./' + executable, img, res, ref])
-
-        if resCode == 0 and not os.path.isfile(diffName):
-            stats['correct'] += 1
-        
-        elif resCode == 0: # Diff file exists
-            stats['failed'] += 1
-            diffPath = os.path.join(baseDir, dirs['dif'], name.replace('jpg', 'png'))
-            shutil.move("diff.png", diffPath)
-        
-        else: # QR-Code was not found
-            stats['notFound'] += 1
-            errPath = os.path.join(baseDir, dirs['err'], name)
-            shutil.copyfile(img, errPath)
-            
-        print()
-        
-        if os.path.isfile(diffName):
-            os.remove(diffName)
-            
     return stats
 
 
@@ -79,4 +90,6 @@ if __name__ == '__main__':
     if stats['all'] > 0:
         print('%d QR-Codes komplett richtig erkannt (%.2f%%)' %(stats['correct'], stats['correct'] / stats['all'] * 100))
         print('%d QR-Codes teilweise richtig erkannt (%.2f%%)' %(stats['failed'], stats['failed'] / stats['all'] * 100))
+        print('%d QR-Codes ohne Referenzbild erkannt (%.2f%%)' %(stats['found'], stats['found'] / stats['all'] * 100))
         print('In %d Bildern wurde kein QR-Codes gefunden (%.2f%%)' %(stats['notFound'], stats['notFound'] / stats['all'] * 100))
+        print('%d Bilder konnten nicht geladen werden (%.2f%%)' %(stats['loadFailed'], stats['loadFailed'] / stats['all'] * 100))
@@ -0,0 +1,30 @@
+#include "imageview.h"
+
+ImageView::ImageView(const uchar* data, int width, int height, size_t stride, Format format)
+    : data(data)
+    , width(width)
+    , height(height)
+    , stride(stride)
+    , format(format)
+{
+}
+
+cv::Mat ImageView::toMat(cv::Mat& buffer) const {
+    uchar* pixels = const_cast<uchar*>(data); // Only read by the detector.
+
+    switch(format) {
+        case FORMAT_BGR:
+            return cv::Mat(height, width, CV_8UC3, pixels, stride);
+
+        case FORMAT_YUYV:
+        case FORMAT_UYVY: {
+            // Luminance is every second byte, gather it in a single pass.
+            cv::Mat packed(height, width, CV_8UC2, pixels, stride);
+            cv::extractChannel(packed, buffer, (format == FORMAT_YUYV) ? 0 : 1);
+            return buffer;
+        }
+
+        default:
+            return cv::Mat(height, width, CV_8UC1, pixels, stride);
+    }
+}
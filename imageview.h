@@ -0,0 +1,41 @@
+#ifndef QR_CODE_IMAGEVIEW_H
+#define QR_CODE_IMAGEVIEW_H
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * Non-owning view onto a frame buffer, as being delivered by cameras. Since the
+ * detector only needs the luminance, planar YUV formats are processed by their
+ * Y plane right inside the buffer. The buffer must stay valid while being processed.
+ */
+struct ImageView {
+
+    // Pixel formats of the buffer.
+    enum Format {
+        FORMAT_GRAY, // 8 bit luminance.
+        FORMAT_BGR,  // 8 bit per channel, interleaved.
+        FORMAT_NV12, // Y plane followed by interleaved U and V, only the Y plane is read.
+        FORMAT_NV21, // Y plane followed by interleaved V and U, only the Y plane is read.
+        FORMAT_I420, // Y, U and V planes, only the Y plane is read.
+        FORMAT_YUYV, // Packed Y0 U Y1 V.
+        FORMAT_UYVY, // Packed U Y0 V Y1.
+    };
+
+    const uchar* data; // First row, of the Y plane for planar formats.
+    int width;
+    int height;
+    size_t stride;     // Distance between two rows in bytes, of the Y plane for planar formats.
+    Format format;
+
+    ImageView(const uchar* data, int width, int height, size_t stride, Format format);
+
+    /**
+     * Provides the view as an image the detector is able to process.
+     * @param buffer receives the luminance of packed formats, which cannot be referenced in place
+     * @return a CV_8UC1 or CV_8UC3 image referencing the frame buffer, or the buffer for packed formats
+     */
+    cv::Mat toMat(cv::Mat& buffer) const;
+};
+
+
+#endif //QR_CODE_IMAGEVIEW_H
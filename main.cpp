@@ -1,22 +1,37 @@
 #include <opencv2/opencv.hpp>
 
+#include <fstream>
+
+#include <unistd.h>
+
+#include "batchprocessor.h"
+#include "corpusfile.h"
+#include "detectionserver.h"
+#include "framepipeline.h"
+#include "qrcache.h"
+#include "qrdecoder.h"
 #include "qrdetector.h"
+#include "qrtracker.h"
+#include "qrutils.h"
 
 //////////////////////////////////////////////////////
 /// Preprocessor definition section
 ///
 //#define MODE_WEBCAM // uncomment this line to use webcam
 #define MODE_RELEASE // uncomment this line for evaluation build
-#define TRY_SCALING // uncomment to try input image with another resolution, in case QR-Code has not been found
+#define FUSED_PREPROCESSING // uncomment to binarize the input by a single fused kernel
+#define DIRECT_SAMPLING // uncomment to sample the modules without warping the code
+#define TRY_SCALING // uncomment to search the input image on multiple resolutions, in case QR-Code has not been found
+//#define CACHE_RESULTS // uncomment to reuse the results of near-identical webcam frames, instead of tracking the code
+//#define ASYNC_CAPTURE // uncomment to capture and detect webcam frames on separate threads, always detecting the latest frame
 //////////////////////////////////////////////////////
 
 //////////////////////////////////////////////////////
 /// Constants definition section
 ///
-static const int IMAGE_UPSCALE = 1500;
-static const int IMAGE_DOWNSCALE = 400;
 static const char* DEFAULT_REFERENCE = nullptr;
 static const char* DEFAULT_DIFF = "diff.png";
+static const char* DEFAULT_SUMMARY = "summary.txt";
 //////////////////////////////////////////////////////
 
 #if defined(MODE_WEBCAM) && defined(MODE_RELEASE)
@@ -24,49 +39,192 @@ static const char* DEFAULT_DIFF = "diff.png";
 #endif
 
 /**
- * Resizes the input image, that the smallest dimension matches
- * the <p>minDimension</p> and the aspect ratio is preserved.
- * @param image the image being about to be resized
- * @return the resized image
+ * Decodes a whole directory or list of images into a corpus file, to be processed by batch mode or the benchmark.
+ * Usage: qr_detector --pack <input> <corpus file> [<reference directory>]
+ * @return EXIT_SUCCESS, if the corpus file has been written
+ */
+int runPack(int argc, char** argv) {
+    if(argc < 4) {
+        std::cout << "Usage: qr_detector --pack <input directory or list file> <corpus file> [<reference directory>]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> inputs = BatchProcessor::collectInputs(argv[2]);
+    if(inputs.empty()) {
+        std::cout << "No input images found!" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> failed;
+    if(!CorpusFile::write(argv[3], inputs, (argc > 4) ? argv[4] : "", &failed)) {
+        std::cout << "Writing corpus failed!" << std::endl;
+        return EXIT_FAILURE;
+    }
+    for(const std::string& input : failed)
+        std::cout << "Failed to load " << input << std::endl;
+    std::cout << "Packed " << inputs.size() - failed.size() << " images." << std::endl;
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Processes a whole directory, list of images or corpus file within this process.
+ * Usage: qr_detector --batch [-j <threads>] [--compact] <input> <output directory> [<reference directory>]
+ * @return EXIT_SUCCESS, if all images have been processed
+ */
+int runBatch(int argc, char** argv, const QRDetector& detector) {
+    BatchProcessor::Options options;
+    options.detector = detector;
+#ifndef TRY_SCALING
+    options.tryScaling = false;
+#endif
+
+    int arg = 2;
+    if(argc > arg + 1 && std::string(argv[arg]) == "-j") {
+        options.workers = std::atoi(argv[arg + 1]);
+        options.decoders = std::max(1, options.workers / 2);
+        arg += 2;
+    }
+    if(argc > arg && std::string(argv[arg]) == "--compact") {
+        options.compact = true;
+        arg++;
+    }
+    if(argc < arg + 2) {
+        std::cout << "Usage: qr_detector --batch [-j <threads>] [--compact] <input directory, list or corpus file> <output directory> [<reference directory>]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string outputDir = argv[arg + 1];
+    std::string referenceDir = (argc > arg + 2) ? argv[arg + 2] : "";
+    BatchProcessor processor(options);
+    std::vector<BatchProcessor::Result> results;
+
+    // Corpus files carry their references, so the reference directory is not needed.
+    if(CorpusFile::isCorpusFile(argv[arg])) {
+        CorpusFile corpus;
+        if(!corpus.open(argv[arg])) {
+            std::cout << "Failed to open corpus " << argv[arg] << std::endl;
+            return EXIT_FAILURE;
+        }
+        results = processor.process(corpus, outputDir);
+    } else {
+        std::vector<std::string> inputs = BatchProcessor::collectInputs(argv[arg]);
+        if(inputs.empty()) {
+            std::cout << "No input images found!" << std::endl;
+            return EXIT_FAILURE;
+        }
+        results = processor.process(inputs, outputDir, referenceDir);
+    }
+
+    // Write summary to both, console and output directory.
+    std::ofstream summary((outputDir + "/" + DEFAULT_SUMMARY).c_str());
+    BatchProcessor::writeSummary(summary, results);
+    BatchProcessor::writeSummary(std::cout, results);
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Serves detection requests, until the input is closed. Requests are read from stdin
+ * and answered on stdout, unless a Unix domain socket is given.
+ * Usage: qr_detector --serve [-j <threads>] [<socket path>]
+ * @return EXIT_SUCCESS, if all requests have been served
  */
-cv::Mat resizeImage(const cv::Mat& img, int minDimension) {
-    double minDim = std::min<double>(img.rows, img.cols);
-    double scale = minDimension / minDim;
+int runServer(int argc, char** argv, const QRDetector& detector) {
+    DetectionServer::Options options;
+    options.detector = detector;
+#ifndef TRY_SCALING
+    options.tryScaling = false;
+#endif
 
-    cv::Mat scaledImg;
+    int arg = 2;
+    if(argc > arg + 1 && std::string(argv[arg]) == "-j") {
+        options.workers = std::atoi(argv[arg + 1]);
+        arg += 2;
+    }
+    if(argc > arg + 1) {
+        std::cerr << "Usage: qr_detector --serve [-j <threads>] [<socket path>]" << std::endl;
+        return EXIT_FAILURE;
+    }
 
-    int interpolater = (scale > 1) ? cv::INTER_CUBIC : cv::INTER_NEAREST;
-    cv::resize(img, scaledImg, cv::Size(), scale, scale, interpolater);
+    DetectionServer server(options);
+    if(argc > arg) {
+        server.listen(argv[arg]);
+        std::cerr << "Listening on " << argv[arg] << " failed!" << std::endl;
+        return EXIT_FAILURE;
+    }
 
-    return scaledImg;
+    return server.serve(STDIN_FILENO, STDOUT_FILENO) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 /// Main function.
 int main(int argc, char** argv) {
 
+    // Initialize an instance of our QR Detector.
+    QRDetector detector;
+#ifdef FUSED_PREPROCESSING
+    detector.setFusedPreprocessing(true);
+#endif
+#ifdef DIRECT_SAMPLING
+    detector.setDirectSampling(true);
+#endif
+
     // Parse command line arguments
+    bool validOptions = parseDetectorOptions(argc, argv, detector);
+
+    // Batch mode processes many images at once.
+    if(validOptions && argc > 1 && std::string(argv[1]) == "--batch")
+        return runBatch(argc, argv, detector);
+
+    // Pack mode decodes images into a corpus file once.
+    if(validOptions && argc > 1 && std::string(argv[1]) == "--pack")
+        return runPack(argc, argv);
+
+    // Server mode answers requests of a long-running stream.
+    if(validOptions && argc > 1 && std::string(argv[1]) == "--serve")
+        return runServer(argc, argv, detector);
+
     const char* input = nullptr;
     const char* output = nullptr;
     const char* reference = DEFAULT_REFERENCE;
-    if(argc > 2) {
+    if(validOptions && argc > 2) {
         input = argv[1];
         output = argv[2];
         if(argc > 3)
             reference = argv[3];
     } else {
-        std::cout << "Usage: qr_detector <input image file> <output image file> [<reference image file>]" << std::endl;
+        std::cout << "Usage: qr_detector <input image file> <output image file or .qrb record> [<reference image file>]" << std::endl;
+        std::cout << "       qr_detector --batch [-j <threads>] [--compact] <input directory, list or corpus file> <output directory> [<reference directory>]" << std::endl;
+        std::cout << "       qr_detector --serve [-j <threads>] [<socket path>]" << std::endl;
+        std::cout << "       qr_detector --pack <input directory or list file> <corpus file> [<reference directory>]" << std::endl;
+        std::cout << "Options: --backend=contour|scanline --sampling=direct|warp --preprocessing=fused|opencv --binarization=otsu|sauvola|bradley --threads=<n> --prescreen=<min. runs>" << std::endl;
+        std::cout << "         --canny=<lower>,<upper> --median=<n> --sample-threshold=<t> --epsilon=<e> --max-area=<r> --adaptive=<radius>,<k> --prescreen-size=<px>" << std::endl;
         return EXIT_FAILURE;
     }
 
     // This will hold the captured images.
     cv::Mat image;
 
-    // Initialize an instance of our QR Detector.
-    QRDetector detector;
-
 #ifdef MODE_WEBCAM
     // Create a device for capturing images.
     cv::VideoCapture capture(0); // 0 - taking the first device being found
+
+#if defined(ASYNC_CAPTURE)
+    // Capture and detect on separate threads, frames arriving while all workers are busy being dropped.
+    FramePipeline::Options pipelineOptions;
+    pipelineOptions.detector = detector;
+    FramePipeline pipeline(pipelineOptions);
+    if(!pipeline.start(capture)) {
+        std::cout << "Failed opening camera!" << std::endl;
+        return EXIT_FAILURE;
+    }
+#elif defined(CACHE_RESULTS)
+    // Reuse the results of frames, which did not change.
+    QRResultCache cache(detector);
+#else
+    // Follow the code between frames, instead of detecting it from scratch.
+    QRTracker tracker(detector);
+#endif
 #else
     // Load the image.
     image = cv::imread(input);
@@ -80,37 +238,66 @@ int main(int argc, char** argv) {
 
     // Configure debug output.
     int debug = QRDetector::DEBUG_ALIGNED | QRDetector::DEBUG_AUGMENTED | QRDetector::DEBUG_BINARY | QRDetector::DEBUG_EDGE;
+#ifndef MODE_WEBCAM
+    QRDetectorContext context;
+#endif
 
     // Main Loop, quit on keypress.
     while (cv::waitKey(1) != 'q') {
 
 #ifdef MODE_WEBCAM
-        // Capture a new image.
+#if defined(ASYNC_CAPTURE)
+        // Take the result of the next frame, which has been detected in the background.
+        FramePipeline::Result frame;
+        if(!pipeline.next(frame))
+            break;
+        image = frame.image;
+        cv::Mat result = frame.code;
+#elif defined(CACHE_RESULTS)
+        // Capture a new image and reuse the result of a similar one.
+        capture >> image;
+        cv::Mat result = cache.detect(image, debug);
+        const QRDetectorContext& context = cache.context();
+#else
+        // Capture a new image and track the qr code.
         capture >> image;
+        cv::Mat result = tracker.track(image, debug);
+        const QRDetectorContext& context = tracker.context();
+#endif
+#else
+        // Extract the qr code.
+        cv::Mat result = detector.detectQRCode(image, context, debug);
+#endif
+
+#if defined(QR_DEBUG_WINDOWS) && !(defined(MODE_WEBCAM) && defined(ASYNC_CAPTURE))
+        // Show the intermediate images, being requested by the debug flags.
+        for(const QRDetectorContext::DebugImage& debugImage : context.debugImages())
+            cv::imshow(debugImage.first, debugImage.second);
 #endif
-        // Extract the qr code and show the result.
-        cv::Mat result = detector.detectQRCode(image, debug);
+        // Show the result.
         if(!result.empty())
             cv::imshow("result", result);
         else
             cv::imshow("input", image);
     }
 
+#if defined(MODE_WEBCAM) && defined(ASYNC_CAPTURE)
+    pipeline.stop();
+    FramePipeline::Stats stats = pipeline.stats();
+    std::cout << "Frames captured: " << stats.captured << ", dropped: " << stats.dropped << ", delivered: " << stats.delivered << std::endl;
+    std::cout << "Capture to result [ms]: mean " << stats.meanMilliseconds << ", max " << stats.maxMilliseconds << std::endl;
+#endif
+
 #else
 
     bool codeFound = false;
 
-    cv::Mat qr = detector.detectQRCode(image);
+    // The context keeps the location of the code, being written into compact records.
+    QRDetectorContext context;
 #ifdef TRY_SCALING
-    // Sometimes rescaling the image improves edge-detection and therefore QR-Code detection.
-    if(qr.empty()) {
-        cv::Mat img = resizeImage(image, IMAGE_DOWNSCALE);
-        qr = detector.detectQRCode(img);
-    }
-    if(qr.empty()) {
-        cv::Mat img = resizeImage(image, IMAGE_UPSCALE);
-        qr = detector.detectQRCode(img);
-    }
+    cv::Mat qr = detectWithScaling(detector, image, true, context);
+#else
+    cv::Mat qr = detector.detectQRCode(image, context);
 #endif
     if(qr.empty()) {
         std::cout << "QR Code not found!" << std::endl;
@@ -118,47 +305,46 @@ int main(int argc, char** argv) {
     } else {
         std::cout << "QR Code found!" << std::endl;
         codeFound = true;
-    }
 
-    // Deactivate compression.
-    std::vector<int> params;
-    params.push_back(CV_IMWRITE_PNG_COMPRESSION);
-    params.push_back(0);
+        // Decode the content right away.
+        QRDecoder::Result decoded = QRDecoder().decode(qr);
+        if(decoded.status == QRDecoder::STATUS_OK)
+            std::cout << "Payload: " << decoded.payload << std::endl;
+        else
+            std::cout << "Decoding failed!" << std::endl;
+    }
 
-    if(cv::imwrite(output, qr, params))
+    // Results named *.qrb are written as bit-packed records, along with the code's corners.
+    const std::string outputFile = output;
+    bool written;
+    if(outputFile.size() > 4 && outputFile.compare(outputFile.size() - 4, 4, ".qrb") == 0) {
+        BitMatrix bits;
+        written = bits.fromMat(codeFound ? qr : cv::Mat()) && writeCompact(outputFile, bits, context.code());
+    } else {
+        written = writeUncompressed(output, qr);
+    }
+    if(written)
         std::cout << "Result successfully written!" << std::endl;
     else
         std::cout << "Writing Result failed!" << std::endl;
 
     // Compare with reference image.
     if(reference && codeFound) {
-        int errors = 0;
         cv::Mat diff;
         std::cout << "Comparison yields: ";
         cv::Mat ref = cv::imread(reference, cv::IMREAD_GRAYSCALE);
-        if(ref.cols == qr.cols && ref.rows == qr.rows && ref.type() == qr.type()) {
-            diff = cv::Mat::zeros(ref.rows, ref.cols, CV_8UC1);
-            for(int r = 0; r < ref.rows; r++) {
-                for(int c = 0; c < ref.cols; c++) {
-                    if(ref.at<uchar>(r, c) != qr.at<uchar>(r, c)) {
-                        diff.at<uchar>(r, c) = 255;
-                        errors++;
-                    }
-                }
-            }
-            if(!errors) {
-                std::cout << "perfect match!" << std::endl;
-                return EXIT_SUCCESS;
-            }
+        int errors = compareWithReference(qr, ref, diff);
+        if(!errors) {
+            std::cout << "perfect match!" << std::endl;
+            return EXIT_SUCCESS;
+        }
 
+        if(errors > 0)
             std::cout << "errors found: " << errors << "/" << ref.cols*ref.rows << std::endl;
-        } else {
-            diff = cv::Mat::zeros(1, 1, CV_8UC1);
-            diff.at<uchar>(0, 0) = 255;
+        else
             std::cout << "size or type not equals. Dimensions: " << qr.rows << " <-> " << ref.rows << std::endl;
-        }
 
-        if(!cv::imwrite(DEFAULT_DIFF, diff, params))
+        if(!writeUncompressed(DEFAULT_DIFF, diff))
             std::cout << "Writing diff file failed!" << std::endl;
 
     } else if(!codeFound)
@@ -0,0 +1,76 @@
+#include <opencv2/opencv.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "batchprocessor.h"
+#include "qrdetector.h"
+
+//////////////////////////////////////////////////////
+/// Constants definition section
+///
+static const char* DEFAULT_IMAGES = "tests/images";
+static const int PRESCREEN_MIN_RUNS = 12;
+static const int TIMING_RUNS = 100;
+//////////////////////////////////////////////////////
+
+/**
+ * Regression check of the prescreen, searching each image of tests/images with the
+ * prescreen being disabled and enabled. Every code found without the prescreen has
+ * to be found with it as well, while a blank frame has to be rejected by it. Reports
+ * the time taken to reject a blank 12 megapixel frame. Run from the source directory,
+ * or pass the image directory.
+ */
+int main(int argc, char** argv) {
+    std::string imageDir = (argc > 1) ? argv[1] : DEFAULT_IMAGES;
+
+    QRDetector plain, prescreened;
+    prescreened.setPrescreen(PRESCREEN_MIN_RUNS);
+    QRDetectorContext context;
+
+    int failures = 0, found = 0, passed = 0;
+    const std::vector<std::string> inputs = BatchProcessor::collectInputs(imageDir);
+    for(const std::string& input : inputs) {
+        cv::Mat image = cv::imread(input);
+        if(image.empty()) {
+            std::cout << "FAILED " << input << ": cannot load the image" << std::endl;
+            failures++;
+            continue;
+        }
+
+        const bool withoutPrescreen = !plain.detectQRCodeScaled(image, context).empty();
+        const bool withPrescreen = !prescreened.detectQRCodeScaled(image, context).empty();
+        const bool rejected = context.failure() == QRDetector::FAILURE_PRESCREEN;
+        std::cout << input << ": " << (withoutPrescreen ? "found" : "not found") << " without, "
+                  << (withPrescreen ? "found" : (rejected ? "rejected" : "not found")) << " with prescreen" << std::endl;
+
+        found += withoutPrescreen;
+        passed += !rejected;
+        if(withoutPrescreen && !withPrescreen) {
+            std::cout << "FAILED " << input << ": lost by the prescreen" << std::endl;
+            failures++;
+        }
+    }
+    if(inputs.empty()) {
+        std::cout << "FAILED " << imageDir << ": no images found" << std::endl;
+        failures++;
+    }
+
+    // A frame without any structure must not pass, which is where the prescreen pays off.
+    cv::Mat blank(3000, 4000, CV_8UC3, cv::Scalar(128, 128, 128));
+    if(!prescreened.detectQRCodeScaled(blank, context).empty() || context.failure() != QRDetector::FAILURE_PRESCREEN) {
+        std::cout << "FAILED blank frame: not rejected" << std::endl;
+        failures++;
+    }
+    const int64 start = cv::getTickCount();
+    for(int i = 0; i < TIMING_RUNS; i++)
+        prescreened.detectQRCodeScaled(blank, context);
+    const double microseconds = (cv::getTickCount() - start) * 1e6 / cv::getTickFrequency() / TIMING_RUNS;
+    std::cout << "blank 4000x3000 frame rejected in " << microseconds << " us" << std::endl;
+
+    std::cout << found << "/" << inputs.size() << " found without prescreen, "
+              << passed << "/" << inputs.size() << " passing the prescreen" << std::endl;
+    std::cout << (failures ? "Prescreen regression failed." : "Prescreen regression passed.") << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+#include "qrcache.h"
+
+#include <bitset>
+#include <iterator>
+
+namespace {
+
+    //! @brief Helper function, converting a single pixel into grayscale, the same way CV_RGB2GRAY does.
+    inline uchar luminance(const cv::Mat& frame, int x, int y) {
+        const uchar* p = frame.ptr(y) + x * frame.channels();
+        if(frame.channels() < 3)
+            return p[0];
+        return cv::saturate_cast<uchar>(0.299 * p[0] + 0.587 * p[1] + 0.114 * p[2]);
+    }
+}
+
+QRResultCache::QRResultCache(const QRDetector& detector, size_t capacity, int tolerance)
+    : detector_(detector)
+    , capacity_(std::max<size_t>(capacity, 1))
+    , tolerance_(tolerance)
+    , hits_(0)
+    , misses_(0)
+    , rejected_(0)
+    , lastFrameCached_(false)
+    , lastFrameFound_(false)
+{
+}
+
+cv::Mat QRResultCache::detect(const cv::Mat& frame, int debug) {
+    Hash hash;
+    computeHash(frame, hash);
+
+    // Look for the closest frame within tolerance.
+    std::list<Entry>::iterator best = entries_.end();
+    int bestDistance = tolerance_ + 1;
+    for(std::list<Entry>::iterator it = entries_.begin(); it != entries_.end(); ++it) {
+        int d = distance(hash, it->hash);
+        if(d < bestDistance) {
+            best = it;
+            bestDistance = d;
+        }
+    }
+
+    // Take the cached result only if the frame still shows the same code, e.g. not a
+    // different one at the same spot. Otherwise the stale entry is dropped.
+    if(best != entries_.end()) {
+        if(verify(frame, *best)) {
+            entries_.splice(entries_.begin(), entries_, best);
+            hits_++;
+            lastFrameCached_ = true;
+            lastFrameFound_ = true;
+            return entries_.front().result;
+        }
+        entries_.erase(best);
+        rejected_++;
+    }
+
+    // Not cached, so detect the code.
+    misses_++;
+    lastFrameCached_ = false;
+    lastFrameFound_ = false;
+    const std::vector<QRDetector::QRCode>& codes = detector_.locateQRCodes(frame, context_, debug);
+    if(codes.empty())
+        return cv::Mat();
+
+    QRDetector::QRCode code = codes.front();
+    cv::Mat result = detector_.sampleQRCode(frame, code, context_, debug);
+    if(result.empty())
+        return cv::Mat();
+
+    // Store the result, reusing the least recently used entry.
+    if(entries_.size() < capacity_)
+        entries_.emplace_front();
+    else
+        entries_.splice(entries_.begin(), entries_, std::prev(entries_.end()));
+
+    Entry& entry = entries_.front();
+    entry.hash = hash;
+    entry.code = code;
+    result.copyTo(entry.result);
+    entry.bits.fromMat(entry.result);
+    lastFrameFound_ = true;
+    return entry.result;
+}
+
+const QRDetector::QRCode* QRResultCache::code() const {
+    return lastFrameFound_ ? &entries_.front().code : nullptr;
+}
+
+bool QRResultCache::lastFrameCached() const {
+    return lastFrameCached_;
+}
+
+void QRResultCache::setTolerance(int tolerance) {
+    tolerance_ = tolerance;
+}
+
+void QRResultCache::clear() {
+    entries_.clear();
+    lastFrameFound_ = false;
+}
+
+size_t QRResultCache::hits() const {
+    return hits_;
+}
+
+size_t QRResultCache::misses() const {
+    return misses_;
+}
+
+size_t QRResultCache::rejected() const {
+    return rejected_;
+}
+
+bool QRResultCache::verify(const cv::Mat& frame, const Entry& entry) {
+    const int n = entry.bits.size();
+    if(n == 0 || frame.depth() != CV_8U)
+        return false;
+
+    // Map the center of each module through the cached corners, the same way sampleGrid does,
+    // reading a single pixel only. Neither warping nor binarizing the code's region is needed.
+    const float size = static_cast<float>(n);
+    cv::Point2f srcQuad[] = {entry.code.a, entry.code.b, entry.code.c, entry.code.d};
+    cv::Point2f dstQuad[] = {
+            {0.0f,  size},
+            {0.0f,  0.0f},
+            {size,  0.0f},
+            {size,  size},
+    };
+    cv::Mat sampleMat = cv::getPerspectiveTransform(dstQuad, srcQuad);
+    double h[9];
+    for(int i=0; i<9; i++)
+        h[i] = sampleMat.at<double>(i / 3, i % 3);
+
+    samples_.resize(n * n);
+    double dark = 0.0, light = 0.0;
+    int darkCount = 0;
+    for(int r=0; r<n; r++) {
+        const double v = r + 0.5;
+        for(int c=0; c<n; c++) {
+            const double u = c + 0.5;
+            const double w = h[6] * u + h[7] * v + h[8];
+            const int x = cvRound((h[0] * u + h[1] * v + h[2]) / w);
+            const int y = cvRound((h[3] * u + h[4] * v + h[5]) / w);
+            if(x < 0 || y < 0 || x >= frame.cols || y >= frame.rows)
+                return false;
+
+            const uchar value = luminance(frame, x, y);
+            samples_[r * n + c] = value;
+            if(entry.bits.get(r, c)) {
+                dark += value;
+                darkCount++;
+            } else {
+                light += value;
+            }
+        }
+    }
+
+    // Threshold midway between the modules being dark and light in the cached code. Once the
+    // code has moved, both means approach each other, as does a frame without any structure.
+    if(darkCount == 0 || darkCount == n * n)
+        return false;
+    dark /= darkCount;
+    light /= n * n - darkCount;
+    if(light - dark < MIN_MODULE_CONTRAST)
+        return false;
+
+    const double threshold = 0.5 * (dark + light);
+    int differences = 0;
+    for(int i=0; i<n*n; i++)
+        differences += (samples_[i] < threshold) != entry.bits.get(i / n, i % n);
+    return differences <= MAX_MODULE_DIFFERENCE * n * n;
+}
+
+void QRResultCache::computeHash(const cv::Mat& frame, Hash& hash) {
+
+    // Area interpolation averages all pixels, such that noise cancels out.
+    // Shrinking first leaves only a few pixels to be converted into grayscale.
+    cv::resize(frame, thumbnail_, cv::Size(HASH_SIZE, HASH_SIZE), 0, 0, cv::INTER_AREA);
+    if(thumbnail_.channels() == 1)
+        grayThumbnail_ = thumbnail_;
+    else
+        cv::cvtColor(thumbnail_, grayThumbnail_, CV_RGB2GRAY);
+
+    // Binarize by the mean, one bit per pixel.
+    const uchar threshold = cv::saturate_cast<uchar>(cv::mean(grayThumbnail_)[0]);
+    hash.fill(0);
+    for(int i = 0; i < HASH_SIZE * HASH_SIZE; i++) {
+        if(grayThumbnail_.at<uchar>(i / HASH_SIZE, i % HASH_SIZE) > threshold)
+            hash[i / 64] |= uint64_t(1) << (i % 64);
+    }
+}
+
+int QRResultCache::distance(const Hash& a, const Hash& b) {
+    int d = 0;
+    for(int i = 0; i < HASH_WORDS; i++)
+        d += static_cast<int>(std::bitset<64>(a[i] ^ b[i]).count());
+    return d;
+}
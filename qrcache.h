@@ -0,0 +1,115 @@
+#ifndef QR_CODE_QRCACHE_H
+#define QR_CODE_QRCACHE_H
+
+#include <opencv2/opencv.hpp>
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <vector>
+
+#include "bitmatrix.h"
+#include "qrdetector.h"
+
+/**
+ * Bounded cache of detection results in front of a detector, for streams of
+ * near-identical frames. Each frame is shrunk to a tiny thumbnail, which is
+ * binarized by its mean into a perceptual hash. Frames whose hash differs by
+ * no more than the tolerance from a cached one are sampled at its corners,
+ * reading a single pixel per module, which skips locating and aligning the
+ * code. The cached result is taken, if the modules match it, otherwise the
+ * frame is detected from scratch. Frames without any
+ * code are never cached, as a small code appearing later hardly changes the
+ * hash. The least recently used entry is replaced, once the cache is full.
+ */
+class QRResultCache {
+
+    // Edge length of the thumbnail being hashed, one bit per pixel.
+    static constexpr int HASH_SIZE = 16;
+    static constexpr int HASH_WORDS = HASH_SIZE * HASH_SIZE / 64;
+
+public:
+
+    // Default number of cached frames.
+    static constexpr size_t DEFAULT_CAPACITY = 8;
+
+    // Default number of differing hash bits, which still count as the same frame.
+    static constexpr int DEFAULT_TOLERANCE = 6;
+
+    // Max. fraction of modules differing from the cached code, when sampled at its corners.
+    static constexpr double MAX_MODULE_DIFFERENCE = 0.02;
+
+    // Min. difference between the mean gray values of dark and light modules, when sampled at the cached corners.
+    static constexpr double MIN_MODULE_CONTRAST = 32.0;
+
+    explicit QRResultCache(const QRDetector& detector = QRDetector(), size_t capacity = DEFAULT_CAPACITY, int tolerance = DEFAULT_TOLERANCE);
+
+    /**
+     * Processes the next frame, taking the result of a similar frame if cached.
+     * @param frame the current frame
+     * @param debug Optional debug flags, only applying to frames not being cached
+     * @return the normalized QR Code, or an empty matrix. It shares its data with the cache.
+     */
+    cv::Mat detect(const cv::Mat& frame, int debug = QRDetector::DEBUG_NONE);
+
+    //! @brief The code of the last frame, or nullptr if none has been found.
+    const QRDetector::QRCode* code() const;
+
+    //! @brief Whether the result of the last frame has been taken from the cache.
+    bool lastFrameCached() const;
+
+    //! @brief Sets the number of differing hash bits, which still count as the same frame.
+    void setTolerance(int tolerance);
+
+    //! @brief The context of the last frame's detection, holding its debug images.
+    const QRDetectorContext& context() const { return context_; }
+
+    //! @brief Drops all cached results.
+    void clear();
+
+    //! @brief Number of frames, whose result has been taken from the cache.
+    size_t hits() const;
+
+    //! @brief Number of frames, which needed to be detected, including the rejected ones.
+    size_t misses() const;
+
+    //! @brief Number of frames matching a cached hash, whose modules did not match the cached code.
+    size_t rejected() const;
+
+private:
+
+    typedef std::array<uint64_t, HASH_WORDS> Hash;
+
+    // A cached frame.
+    struct Entry {
+        Hash hash;
+        QRDetector::QRCode code;
+        BitMatrix bits;
+        cv::Mat result;
+    };
+
+    //! @brief Computes the perceptual hash of a frame.
+    void computeHash(const cv::Mat& frame, Hash& hash);
+
+    //! @brief Counts the differing bits of two hashes.
+    static int distance(const Hash& a, const Hash& b);
+
+    //! @brief Samples the frame at the corners of a cached code, checking whether it still shows that code.
+    bool verify(const cv::Mat& frame, const Entry& entry);
+
+    QRDetector detector_;
+    QRDetectorContext context_;
+    std::list<Entry> entries_; // Most recently used first.
+    size_t capacity_;
+    int tolerance_;
+    size_t hits_;
+    size_t misses_;
+    size_t rejected_;
+    bool lastFrameCached_;
+    bool lastFrameFound_;
+    cv::Mat thumbnail_, grayThumbnail_;
+    std::vector<uchar> samples_;
+};
+
+
+#endif //QR_CODE_QRCACHE_H
@@ -0,0 +1,560 @@
+#include "qrdecoder.h"
+
+#include <bitset>
+
+// Error correction codewords per block, indexed by level (L, M, Q, H) and version.
+static const int ECC_CODEWORDS_PER_BLOCK[4][41] = {
+    {-1,  7, 10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30, 22, 24, 28, 30, 28, 28, 28, 28, 30, 30, 26, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+    {-1, 10, 16, 26, 18, 24, 16, 18, 22, 22, 26, 30, 22, 22, 24, 24, 28, 28, 26, 26, 26, 26, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28},
+    {-1, 13, 22, 18, 26, 18, 24, 18, 22, 20, 24, 28, 26, 24, 20, 30, 24, 28, 28, 26, 30, 28, 30, 30, 30, 30, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+    {-1, 17, 28, 22, 16, 22, 28, 26, 26, 24, 28, 24, 28, 22, 24, 24, 30, 28, 28, 26, 28, 30, 24, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},
+};
+
+// Number of error correction blocks, indexed by level (L, M, Q, H) and version.
+static const int NUM_ERROR_CORRECTION_BLOCKS[4][41] = {
+    {-1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 4,  4,  4,  4,  4,  6,  6,  6,  6,  7,  8,  8,  9,  9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25},
+    {-1, 1, 1, 1, 2, 2, 4, 4, 4, 5, 5,  5,  8,  9,  9, 10, 10, 11, 13, 14, 16, 17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49},
+    {-1, 1, 1, 2, 2, 4, 4, 6, 6, 8, 8,  8, 10, 12, 16, 12, 17, 16, 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68},
+    {-1, 1, 1, 2, 4, 4, 4, 5, 6, 8, 8, 11, 11, 16, 16, 18, 16, 19, 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81},
+};
+
+// Maps the two level bits of the format information onto the table index and name.
+static const int LEVEL_INDEX[] = {1, 0, 3, 2};
+static const char LEVEL_NAMES[] = {'M', 'L', 'H', 'Q'};
+
+// Characters of the alphanumeric mode.
+static const char ALPHANUMERIC_CHARSET[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+
+namespace {
+
+    // Arithmetic in GF(256), being generated by x^8 + x^4 + x^3 + x^2 + 1.
+    struct GaloisField {
+        uchar exp[512];
+        int log[256];
+
+        GaloisField() {
+            int x = 1;
+            for(int i = 0; i < 255; i++) {
+                exp[i] = static_cast<uchar>(x);
+                log[x] = i;
+                x <<= 1;
+                if(x & 0x100)
+                    x ^= 0x11D;
+            }
+            for(int i = 255; i < 512; i++)
+                exp[i] = exp[i - 255];
+            log[0] = 0; // Undefined, callers check for zero.
+        }
+
+        uchar mul(uchar a, uchar b) const { return (a && b) ? exp[log[a] + log[b]] : 0; }
+        uchar div(uchar a, uchar b) const { return a ? exp[log[a] + 255 - log[b]] : 0; }
+        uchar pow(int e) const { e %= 255; return exp[e < 0 ? e + 255 : e]; }
+    };
+
+    const GaloisField& field() {
+        static const GaloisField gf;
+        return gf;
+    }
+
+    // Reads the payload bit by bit, most significant bit first.
+    class BitReader {
+    public:
+        explicit BitReader(const std::vector<uchar>& data) : data_(data), position_(0) {}
+
+        int available() const { return static_cast<int>(data_.size() * 8 - position_); }
+
+        int read(int bits) {
+            int value = 0;
+            for(int i = 0; i < bits; i++, position_++)
+                value = (value << 1) | ((data_[position_ / 8] >> (7 - position_ % 8)) & 1);
+            return value;
+        }
+
+    private:
+        const std::vector<uchar>& data_;
+        size_t position_;
+    };
+
+    //! @brief Returns the 15 bit format information of the given level and mask bits, including its mask.
+    int formatBits(int data) {
+        int rem = data;
+        for(int i = 0; i < 10; i++)
+            rem = (rem << 1) ^ ((rem >> 9) * 0x537);
+        return ((data << 10) | rem) ^ 0x5412;
+    }
+
+    //! @brief Returns the 18 bit version information of the given version.
+    int versionBits(int version) {
+        int rem = version;
+        for(int i = 0; i < 12; i++)
+            rem = (rem << 1) ^ ((rem >> 11) * 0x1F25);
+        return (version << 12) | rem;
+    }
+
+    //! @brief Counts the bits being different.
+    int hammingDistance(int a, int b) {
+        return static_cast<int>(std::bitset<32>(a ^ b).count());
+    }
+
+    //! @brief Returns the number of modules holding data or error correction bits.
+    int numRawDataModules(int version) {
+        int result = (16 * version + 128) * version + 64;
+        if(version >= 2) {
+            int numAlign = version / 7 + 2;
+            result -= (25 * numAlign - 10) * numAlign - 55;
+            if(version >= 7)
+                result -= 36;
+        }
+        return result;
+    }
+
+    //! @brief Returns the centers of the alignment patterns along each axis.
+    std::vector<int> alignmentPositions(int version) {
+        std::vector<int> result;
+        if(version == 1)
+            return result;
+
+        int size = version * 4 + 17;
+        int numAlign = version / 7 + 2;
+        int step = (version * 8 + numAlign * 3 + 5) / (numAlign * 4 - 4) * 2;
+        result.resize(numAlign);
+        result[0] = 6;
+        for(int i = numAlign - 1, pos = size - 7; i >= 1; i--, pos -= step)
+            result[i] = pos;
+        return result;
+    }
+
+    //! @brief Whether the data mask inverts the module at the given row and column.
+    bool maskBit(int mask, int row, int col) {
+        switch(mask) {
+            case 0: return (row + col) % 2 == 0;
+            case 1: return row % 2 == 0;
+            case 2: return col % 3 == 0;
+            case 3: return (row + col) % 3 == 0;
+            case 4: return (row / 2 + col / 3) % 2 == 0;
+            case 5: return row * col % 2 + row * col % 3 == 0;
+            case 6: return (row * col % 2 + row * col % 3) % 2 == 0;
+            default: return ((row + col) % 2 + row * col % 3) % 2 == 0;
+        }
+    }
+
+    //! @brief Returns the number of bits holding the character count of a segment.
+    int characterCountBits(int mode, int version) {
+        int group = (version <= 9) ? 0 : (version <= 26) ? 1 : 2;
+        switch(mode) {
+            case 1: { static const int bits[] = {10, 12, 14}; return bits[group]; } // Numeric
+            case 2: { static const int bits[] = {9, 11, 13}; return bits[group]; }  // Alphanumeric
+            case 4: { static const int bits[] = {8, 16, 16}; return bits[group]; }  // Byte
+            case 8: { static const int bits[] = {8, 10, 12}; return bits[group]; }  // Kanji
+        }
+        return -1;
+    }
+}
+
+QRDecoder::Result QRDecoder::decode(const cv::Mat& code) const {
+    Result result = {STATUS_SIZE, "", 0, ' ', -1, 0, false};
+    if(code.empty() || code.type() != CV_8UC1 || code.rows != code.cols)
+        return result;
+
+    const int size = code.rows;
+    std::vector<uchar> modules(size * size);
+    for(int r = 0; r < size; r++) {
+        const uchar* row = code.ptr(r);
+        for(int c = 0; c < size; c++)
+            modules[r * size + c] = (row[c] < 128) ? 1 : 0;
+    }
+
+    result = decodeModules(modules, size);
+    if(result.status == STATUS_OK)
+        return result;
+
+    // Retry with rows and columns being swapped, in case the code is mirrored.
+    std::vector<uchar> transposed(size * size);
+    for(int r = 0; r < size; r++)
+        for(int c = 0; c < size; c++)
+            transposed[c * size + r] = modules[r * size + c];
+
+    Result mirrored = decodeModules(transposed, size);
+    if(mirrored.status != STATUS_OK)
+        return result;
+
+    mirrored.mirrored = true;
+    return mirrored;
+}
+
+QRDecoder::Result QRDecoder::decodeModules(const std::vector<uchar>& modules, int size) const {
+    Result result = {STATUS_SIZE, "", 0, ' ', -1, 0, false};
+
+    // Determine the version by the size, larger codes also store it explicitly.
+    if(size < 21 || size > 177 || (size - 17) % 4 != 0)
+        return result;
+    result.version = (size - 17) / 4;
+    if(result.version >= 7 && readVersion(modules, size) != result.version) {
+        result.status = STATUS_VERSION;
+        return result;
+    }
+
+    int format = readFormat(modules, size);
+    if(format < 0) {
+        result.status = STATUS_FORMAT;
+        return result;
+    }
+    const int level = LEVEL_INDEX[format >> 3];
+    result.level = LEVEL_NAMES[format >> 3];
+    result.mask = format & 7;
+
+    // Read all codewords, skipping the function patterns.
+    std::vector<uchar> function, codewords;
+    markFunctionModules(result.version, function);
+    readCodewords(modules, function, size, result.mask, codewords);
+
+    // Blocks differ in length by at most one data codeword, the short ones coming first.
+    const int numBlocks = NUM_ERROR_CORRECTION_BLOCKS[level][result.version];
+    const int eccLength = ECC_CODEWORDS_PER_BLOCK[level][result.version];
+    const int rawCodewords = static_cast<int>(codewords.size());
+    const int numShortBlocks = numBlocks - rawCodewords % numBlocks;
+    const int shortBlockLength = rawCodewords / numBlocks;
+    const int shortDataLength = shortBlockLength - eccLength;
+
+    // De-interleave the codewords, short blocks being padded to the length of the long ones.
+    std::vector<uchar> blocks(numBlocks * (shortBlockLength + 1));
+    int index = 0;
+    for(int i = 0; i <= shortBlockLength; i++) {
+        for(int b = 0; b < numBlocks; b++) {
+            if(i != shortDataLength || b >= numShortBlocks)
+                blocks[b * (shortBlockLength + 1) + i] = codewords[index++];
+        }
+    }
+
+    // Correct each block and collect the data codewords.
+    std::vector<uchar> data;
+    for(int b = 0; b < numBlocks; b++) {
+        uchar* block = &blocks[b * (shortBlockLength + 1)];
+        const int dataLength = shortDataLength + (b >= numShortBlocks ? 1 : 0);
+        if(b < numShortBlocks) {
+            // Remove the padding, which precedes the error correction codewords.
+            std::copy(block + shortDataLength + 1, block + shortBlockLength + 1, block + shortDataLength);
+        }
+
+        int corrected = correctBlock(block, dataLength + eccLength, eccLength);
+        if(corrected < 0) {
+            result.status = STATUS_CORRECTION;
+            return result;
+        }
+        result.correctedErrors += corrected;
+        data.insert(data.end(), block, block + dataLength);
+    }
+
+    if(!parseSegments(data, result.version, result.payload)) {
+        result.status = STATUS_DATA;
+        return result;
+    }
+
+    result.status = STATUS_OK;
+    return result;
+}
+
+int QRDecoder::readFormat(const std::vector<uchar>& modules, int size) const {
+    auto module = [&](int r, int c) { return static_cast<int>(modules[r * size + c]); };
+
+    // First copy around the top left finder pattern, skipping the timing patterns.
+    int bits1 = 0;
+    for(int i = 0; i <= 5; i++)
+        bits1 |= module(i, 8) << i;
+    bits1 |= module(7, 8) << 6;
+    bits1 |= module(8, 8) << 7;
+    bits1 |= module(8, 7) << 8;
+    for(int i = 9; i < 15; i++)
+        bits1 |= module(8, 14 - i) << i;
+
+    // Second copy, split between the top right and bottom left finder patterns.
+    int bits2 = 0;
+    for(int i = 0; i < 8; i++)
+        bits2 |= module(8, size - 1 - i) << i;
+    for(int i = 8; i < 15; i++)
+        bits2 |= module(size - 15 + i, 8) << i;
+
+    // Take the closest valid format information.
+    int best = -1, bestDistance = MAX_INFO_ERRORS + 1;
+    for(int data = 0; data < 32; data++) {
+        int code = formatBits(data);
+        int distance = std::min(hammingDistance(bits1, code), hammingDistance(bits2, code));
+        if(distance < bestDistance) {
+            best = data;
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+int QRDecoder::readVersion(const std::vector<uchar>& modules, int size) const {
+    auto module = [&](int r, int c) { return static_cast<int>(modules[r * size + c]); };
+
+    // Both copies are located next to the top right and bottom left finder patterns.
+    int bits1 = 0, bits2 = 0;
+    for(int i = 0; i < 18; i++) {
+        bits1 |= module(i / 3, size - 11 + i % 3) << i;
+        bits2 |= module(size - 11 + i % 3, i / 3) << i;
+    }
+
+    // Take the closest valid version information.
+    int best = -1, bestDistance = MAX_INFO_ERRORS + 1;
+    for(int version = 7; version <= 40; version++) {
+        int code = versionBits(version);
+        int distance = std::min(hammingDistance(bits1, code), hammingDistance(bits2, code));
+        if(distance < bestDistance) {
+            best = version;
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+void QRDecoder::markFunctionModules(int version, std::vector<uchar>& function) const {
+    const int size = version * 4 + 17;
+    function.assign(size * size, 0);
+    auto mark = [&](int row, int col, int rows, int cols) {
+        for(int r = row; r < row + rows; r++)
+            for(int c = col; c < col + cols; c++)
+                function[r * size + c] = 1;
+    };
+
+    // Finder patterns, including separators and format information.
+    mark(0, 0, 9, 9);
+    mark(0, size - 8, 9, 8);
+    mark(size - 8, 0, 8, 9);
+
+    // Timing patterns.
+    mark(6, 0, 1, size);
+    mark(0, 6, size, 1);
+
+    // Alignment patterns, except those overlapping the finder patterns.
+    std::vector<int> positions = alignmentPositions(version);
+    const int last = static_cast<int>(positions.size()) - 1;
+    for(int i = 0; i <= last; i++) {
+        for(int j = 0; j <= last; j++) {
+            if((i == 0 && j == 0) || (i == 0 && j == last) || (i == last && j == 0))
+                continue;
+            mark(positions[i] - 2, positions[j] - 2, 5, 5);
+        }
+    }
+
+    // Version information.
+    if(version >= 7) {
+        mark(0, size - 11, 6, 3);
+        mark(size - 11, 0, 3, 6);
+    }
+}
+
+void QRDecoder::readCodewords(const std::vector<uchar>& modules, const std::vector<uchar>& function, int size, int mask, std::vector<uchar>& codewords) const {
+    const int version = (size - 17) / 4;
+    codewords.assign(numRawDataModules(version) / 8, 0);
+    const int numBits = static_cast<int>(codewords.size()) * 8;
+
+    // Move upwards and downwards in pairs of columns, starting at the bottom right.
+    int bit = 0;
+    for(int right = size - 1; right >= 1; right -= 2) {
+        if(right == 6)
+            right = 5; // Skip the vertical timing pattern.
+
+        const bool upward = ((right + 1) & 2) == 0;
+        for(int vert = 0; vert < size; vert++) {
+            const int row = upward ? size - 1 - vert : vert;
+            for(int j = 0; j < 2; j++) {
+                const int col = right - j;
+                if(function[row * size + col] || bit >= numBits)
+                    continue;
+
+                if(modules[row * size + col] != (maskBit(mask, row, col) ? 1 : 0))
+                    codewords[bit / 8] |= static_cast<uchar>(0x80 >> (bit % 8));
+                bit++;
+            }
+        }
+    }
+}
+
+int QRDecoder::correctBlock(uchar* block, int length, int eccLength) const {
+    const GaloisField& gf = field();
+    const int MAX_ECC = 64;
+    if(eccLength > MAX_ECC)
+        return -1;
+
+    // Evaluate the received polynomial at the roots of the generator.
+    uchar syndromes[MAX_ECC];
+    bool valid = true;
+    for(int j = 0; j < eccLength; j++) {
+        const uchar root = gf.pow(j);
+        uchar s = 0;
+        for(int k = 0; k < length; k++)
+            s = gf.mul(s, root) ^ block[k];
+        syndromes[j] = s;
+        valid &= (s == 0);
+    }
+    if(valid)
+        return 0;
+
+    // Berlekamp-Massey, determining the error locator polynomial.
+    uchar locator[MAX_ECC + 1] = {1};
+    uchar previous[MAX_ECC + 1] = {1};
+    uchar temp[MAX_ECC + 1];
+    int errors = 0, shift = 1;
+    uchar lastDiscrepancy = 1;
+    for(int n = 0; n < eccLength; n++) {
+        uchar d = syndromes[n];
+        for(int i = 1; i <= errors; i++)
+            d ^= gf.mul(locator[i], syndromes[n - i]);
+        if(d == 0) {
+            shift++;
+            continue;
+        }
+
+        const uchar coefficient = gf.div(d, lastDiscrepancy);
+        const bool grow = 2 * errors <= n;
+        if(grow)
+            std::copy(locator, locator + eccLength + 1, temp);
+        for(int i = 0; i + shift <= eccLength; i++)
+            locator[i + shift] ^= gf.mul(coefficient, previous[i]);
+
+        if(grow) {
+            errors = n + 1 - errors;
+            std::copy(temp, temp + eccLength + 1, previous);
+            lastDiscrepancy = d;
+            shift = 1;
+        } else {
+            shift++;
+        }
+    }
+    if(2 * errors > eccLength)
+        return -1;
+
+    // Error evaluator polynomial, being the product of syndromes and locator modulo x^eccLength.
+    uchar evaluator[MAX_ECC] = {0};
+    for(int i = 0; i < eccLength; i++)
+        for(int j = 0; j <= std::min(i, errors); j++)
+            evaluator[i] ^= gf.mul(syndromes[i - j], locator[j]);
+
+    // Find the error positions by the roots of the locator (Chien search) and
+    // determine the error values (Forney). Position p refers to the power of x.
+    int found = 0;
+    for(int p = 0; p < length; p++) {
+        const uchar inverse = gf.pow(-p);
+        uchar value = 0, derivative = 0, x = 1;
+        for(int i = 0; i <= errors; i++) {
+            value ^= gf.mul(locator[i], x);
+            if(i & 1)
+                derivative ^= gf.mul(locator[i], gf.div(x, inverse));
+            x = gf.mul(x, inverse);
+        }
+        if(value != 0)
+            continue;
+
+        uchar numerator = 0;
+        x = 1;
+        for(int i = 0; i < eccLength; i++) {
+            numerator ^= gf.mul(evaluator[i], x);
+            x = gf.mul(x, inverse);
+        }
+        if(derivative == 0)
+            return -1;
+
+        block[length - 1 - p] ^= gf.mul(gf.pow(p), gf.div(numerator, derivative));
+        found++;
+    }
+
+    return (found == errors) ? errors : -1;
+}
+
+bool QRDecoder::parseSegments(const std::vector<uchar>& data, int version, std::string& payload) const {
+    BitReader reader(data);
+    payload.clear();
+
+    while(reader.available() >= 4) {
+        const int mode = reader.read(4);
+        if(mode == 0)
+            break; // Terminator.
+
+        // Extended channel interpretation, the designator takes one to three bytes.
+        if(mode == 7) {
+            if(reader.available() < 8)
+                return false;
+            int first = reader.read(8);
+            int extra = ((first & 0x80) == 0) ? 0 : ((first & 0xC0) == 0x80) ? 8 : 16;
+            if(reader.available() < extra)
+                return false;
+            reader.read(extra);
+            continue;
+        }
+
+        // Structured append and FNC1 only carry meta data.
+        if(mode == 3 || mode == 5 || mode == 9) {
+            int bits = (mode == 3) ? 16 : (mode == 9) ? 8 : 0;
+            if(reader.available() < bits)
+                return false;
+            reader.read(bits);
+            continue;
+        }
+
+        const int countBits = characterCountBits(mode, version);
+        if(countBits < 0 || reader.available() < countBits)
+            return false;
+        int count = reader.read(countBits);
+
+        switch(mode) {
+            case 1: // Numeric, three digits being packed into 10 bits.
+                while(count > 0) {
+                    const int digits = std::min(count, 3);
+                    const int bits = (digits == 3) ? 10 : (digits == 2) ? 7 : 4;
+                    if(reader.available() < bits)
+                        return false;
+                    int value = reader.read(bits);
+                    char buffer[4];
+                    for(int i = digits - 1; i >= 0; i--, value /= 10)
+                        buffer[i] = static_cast<char>('0' + value % 10);
+                    if(value != 0)
+                        return false;
+                    payload.append(buffer, digits);
+                    count -= digits;
+                }
+                break;
+            case 2: // Alphanumeric, two characters being packed into 11 bits.
+                while(count > 0) {
+                    const int chars = std::min(count, 2);
+                    const int bits = (chars == 2) ? 11 : 6;
+                    if(reader.available() < bits)
+                        return false;
+                    int value = reader.read(bits);
+                    if(chars == 2) {
+                        if(value >= 45 * 45)
+                            return false;
+                        payload += ALPHANUMERIC_CHARSET[value / 45];
+                        payload += ALPHANUMERIC_CHARSET[value % 45];
+                    } else {
+                        if(value >= 45)
+                            return false;
+                        payload += ALPHANUMERIC_CHARSET[value];
+                    }
+                    count -= chars;
+                }
+                break;
+            case 4: // Byte, copied as they are.
+                if(reader.available() < 8 * count)
+                    return false;
+                for(int i = 0; i < count; i++)
+                    payload += static_cast<char>(reader.read(8));
+                break;
+            case 8: // Kanji, 13 bits each, yielding Shift JIS.
+                if(reader.available() < 13 * count)
+                    return false;
+                for(int i = 0; i < count; i++) {
+                    int value = reader.read(13);
+                    int assembled = ((value / 0xC0) << 8) | (value % 0xC0);
+                    assembled += (assembled < 0x1F00) ? 0x8140 : 0xC140;
+                    payload += static_cast<char>(assembled >> 8);
+                    payload += static_cast<char>(assembled & 0xFF);
+                }
+                break;
+        }
+    }
+
+    return true;
+}
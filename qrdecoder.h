@@ -0,0 +1,75 @@
+#ifndef QR_CODE_QRDECODER_H
+#define QR_CODE_QRDECODER_H
+
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * Decodes the payload of a normalized QR code, as being returned by the QRDetector.
+ * The format and version information is read with error correction, the data
+ * modules are unmasked and de-interleaved into their blocks, which are corrected
+ * by Reed-Solomon decoding. Numeric, alphanumeric, byte and kanji segments are
+ * supported, ECI designators, structured append and FNC1 headers are skipped.
+ */
+class QRDecoder {
+
+    // Max. bit errors being corrected inside the format and version information.
+    static constexpr int MAX_INFO_ERRORS = 3;
+
+public:
+
+    // Outcome of decoding.
+    enum Status {
+        STATUS_OK,         // The payload has been decoded.
+        STATUS_SIZE,       // The size does not match any version.
+        STATUS_FORMAT,     // The format information could not be read.
+        STATUS_VERSION,    // The version information does not match the size.
+        STATUS_CORRECTION, // Too many errors inside a block.
+        STATUS_DATA,       // The segments could not be parsed.
+    };
+
+    struct Result {
+        Status status;
+        std::string payload;  // Decoded text, byte segments being copied as they are.
+        int version;          // Version, between 1 and 40.
+        char level;           // Error correction level, one of L, M, Q or H.
+        int mask;             // Data mask, between 0 and 7.
+        int correctedErrors;  // Codewords being corrected.
+        bool mirrored;        // Whether rows and columns have been swapped.
+    };
+
+    /**
+     * Decodes a normalized QR code. Codes being mirrored are decoded as well.
+     * @param code the CV_8UC1 module matrix, one pixel per module, dark modules being below 128
+     * @return the decoded payload, valid if the status is STATUS_OK
+     */
+    Result decode(const cv::Mat& code) const;
+
+private:
+
+    //! @brief Decodes the modules, which are stored row by row.
+    Result decodeModules(const std::vector<uchar>& modules, int size) const;
+
+    //! @brief Reads both copies of the format information, returns level and mask bits or -1.
+    int readFormat(const std::vector<uchar>& modules, int size) const;
+
+    //! @brief Reads both copies of the version information, returns the version or -1.
+    int readVersion(const std::vector<uchar>& modules, int size) const;
+
+    //! @brief Marks the function patterns of the given version, which do not hold any data.
+    void markFunctionModules(int version, std::vector<uchar>& function) const;
+
+    //! @brief Reads the codewords in zigzag order, removing the mask.
+    void readCodewords(const std::vector<uchar>& modules, const std::vector<uchar>& function, int size, int mask, std::vector<uchar>& codewords) const;
+
+    //! @brief Corrects a block in place, returns the number of corrected codewords or -1.
+    int correctBlock(uchar* block, int length, int eccLength) const;
+
+    //! @brief Parses the segments of the data codewords into the payload.
+    bool parseSegments(const std::vector<uchar>& data, int version, std::string& payload) const;
+};
+
+
+#endif //QR_CODE_QRDECODER_H
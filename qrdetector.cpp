@@ -1,13 +1,18 @@
 #include "qrdetector.h"
 
+#include <cstring>
+
+#include "binarization.h"
+#include "finderscanner.h"
+
 /**
  * Helper function, calculating the squared distance between two points.
  * @param p0 the first point
  * @param p1 the second point
  * @return the squared distance
  */
-static int distanceSQ(const cv::Point& p0, const cv::Point& p1) {
-    cv::Point d = p1 - p0;
+static float distanceSQ(const cv::Point2f& p0, const cv::Point2f& p1) {
+    cv::Point2f d = p1 - p0;
     return d.dot(d);
 }
 
@@ -19,34 +24,841 @@ static int distanceSQ(const cv::Point& p0, const cv::Point& p1) {
  * @param q the point to be tested
  * @return a value less than 0 if q on the right side, greater than 0 otherwise
  */
-static int orientation(const cv::Point& p0, const cv::Point& p1, const cv::Point& q) {
-    cv::Point n(p1.y - p0.y, p0.x - p1.x);
+static float orientation(const cv::Point2f& p0, const cv::Point2f& p1, const cv::Point2f& q) {
+    cv::Point2f n(p1.y - p0.y, p0.x - p1.x);
     return (q - p0).dot(n);
 }
 
+/**
+ * Helper function, measuring the longest run of light pixels along a line.
+ * @param binary the binary image
+ * @param p0 the start of the line
+ * @param p1 the end of the line
+ * @return the length of the longest run in pixels
+ */
+static double longestLightRun(const cv::Mat& binary, const cv::Point2f& p0, const cv::Point2f& p1) {
+    cv::LineIterator it(binary, p0, p1, 8);
+    if(it.count <= 0)
+        return 0.0;
+
+    int run = 0, longest = 0;
+    for(int i=0; i<it.count; i++, ++it) {
+        run = (**it) ? run + 1 : 0;
+        longest = std::max(longest, run);
+    }
+
+    // Convert the amount of pixels to a length along the line.
+    return longest * cv::norm(p1 - p0) / it.count;
+}
+
+/**
+ * Helper function, determining the side length of a code being aligned,
+ * such that no data gets lost during transformation.
+ * @param code the code
+ * @return the side length in pixels
+ */
+static float alignedSize(const QRDetector::QRCode& code) {
+    return std::ceil(std::sqrt(std::max({distanceSQ(code.a, code.b),
+                                         distanceSQ(code.b, code.c),
+                                         distanceSQ(code.c, code.d),
+                                         distanceSQ(code.d, code.a)}))
+                     );
+}
+
+/**
+ * Helper function, sampling a module of a binary image, taking a neighbourhood
+ * of K into account. Pixels outside the image are skipped.
+ * @param binary the binary image
+ * @param x the column of the module's center
+ * @param y the row of the module's center
+ * @param threshold the mean value, above which the module is light
+ * @return 255 for light modules, 0 otherwise
+ */
+template<int K>
+static uchar sampleModule(const cv::Mat& binary, int x, int y, int threshold) {
+    constexpr int AREA = (2 * K + 1) * (2 * K + 1);
+
+    // Most modules are far enough from the border, such that the whole neighbourhood is summed up unchecked.
+    if(x >= K && y >= K && x < binary.cols - K && y < binary.rows - K) {
+        int sum = 0;
+        for(int i = -K; i <= K; i++) {
+            const uchar* row = binary.ptr(y + i) + x;
+            for(int j = -K; j <= K; j++)
+                sum += row[j];
+        }
+        return (sum / AREA > threshold) ? 255 : 0;
+    }
+
+    int sum = 0, count = 0;
+    for(int r = std::max(y - K, 0); r <= std::min(y + K, binary.rows - 1); r++) {
+        const uchar* row = binary.ptr(r);
+        for(int c = std::max(x - K, 0); c <= std::min(x + K, binary.cols - 1); c++) {
+            sum += row[c];
+            count++;
+        }
+    }
+
+    return (count > 0 && sum / count > threshold) ? 255 : 0;
+}
+
+/**
+ * Helper function, sampling the modules of an aligned binary image, each module being
+ * the mean of the (2K+1)x(2K+1) neighbourhood around its center. The centers are
+ * looked up in a table, holding the same offset for rows and columns. They need to be
+ * at least K pixels away from the border, as there are no bounds checks.
+ * @param binary the aligned binary image
+ * @param centers the offset of each module's center
+ * @param threshold the mean value, above which the module is light
+ * @param result the module matrix, already allocated with one pixel per table entry
+ */
+template<int K>
+static void sampleAlignedGrid(const cv::Mat& binary, const std::vector<int>& centers, int threshold, cv::Mat& result) {
+    constexpr int AREA = (2 * K + 1) * (2 * K + 1);
+    const int n = static_cast<int>(centers.size());
+
+    for(int r=0; r<n; r++) {
+        const uchar* rows[2 * K + 1];
+        for(int i = 0; i < 2 * K + 1; i++)
+            rows[i] = binary.ptr(centers[r] + i - K);
+
+        uchar* out = result.ptr(r);
+        for(int c=0; c<n; c++) {
+            const int x = centers[c] - K;
+            int sum = 0;
+            for(int i = 0; i < 2 * K + 1; i++) {
+                for(int j = 0; j < 2 * K + 1; j++)
+                    sum += rows[i][x + j];
+            }
+            out[c] = (sum / AREA > threshold) ? 255 : 0;
+        }
+    }
+}
+
+namespace {
+
+    // Adds the time spent within its scope to a stage, if statistics are enabled.
+    class StageTimer {
+    public:
+        StageTimer(QRDetector::Stats* stats, QRDetector::Stage stage)
+            : stats_(stats)
+            , stage_(stage)
+            , start_(stats ? cv::getTickCount() : 0)
+        {
+        }
+
+        ~StageTimer() {
+            if(stats_)
+                stats_->milliseconds[stage_] += (cv::getTickCount() - start_) * 1000.0 / cv::getTickFrequency();
+        }
+
+    private:
+        QRDetector::Stats* stats_;
+        QRDetector::Stage stage_;
+        int64 start_;
+    };
+
+    // Runs a function object on the ranges handed out by cv::parallel_for_, without allocating.
+    template<typename Function>
+    class ParallelLoop : public cv::ParallelLoopBody {
+    public:
+        explicit ParallelLoop(const Function& function)
+            : function_(function)
+        {
+        }
+
+        void operator()(const cv::Range& range) const {
+            function_(range);
+        }
+
+    private:
+        const Function& function_;
+    };
+
+    //! @brief Runs the function on the range in parallel, using OpenCV's thread pool.
+    template<typename Function>
+    void parallelFor(const cv::Range& range, const Function& function) {
+        cv::parallel_for_(range, ParallelLoop<Function>(function), range.end - range.start);
+    }
+}
+
+QRDetector::Stats::Stats() {
+    reset();
+}
+
+void QRDetector::Stats::reset() {
+    std::fill(milliseconds, milliseconds + STAGE_COUNT, 0.0);
+    contours = 0;
+    markers = 0;
+    simplifyIterations = 0;
+    codes = 0;
+    scale = 1.0;
+    failure = FAILURE_NONE;
+}
+
+const char* QRDetector::Stats::failureName(Failure failure) {
+    switch(failure) {
+        case FAILURE_NONE:       return "none";
+        case FAILURE_NO_MARKERS: return "nomarkers";
+        case FAILURE_NO_CODE:    return "nocode";
+        case FAILURE_SAMPLING:   return "sampling";
+        case FAILURE_PRESCREEN:  return "prescreen";
+    }
+    return "unknown";
+}
+
+const char* QRDetector::Stats::stageName(Stage stage) {
+    switch(stage) {
+        case STAGE_PREPROCESS: return "preprocess";
+        case STAGE_CONTOURS:   return "contours";
+        case STAGE_FILTER:     return "filter";
+        case STAGE_EXTRACT:    return "extract";
+        case STAGE_ALIGN:      return "align";
+        case STAGE_NORMALIZE:  return "normalize";
+        case STAGE_COUNT:      break;
+    }
+    return "unknown";
+}
+
+QRDetectorContext::QRDetectorContext()
+    : stats(nullptr)
+    , lastFailure(QRDetector::FAILURE_NONE)
+    , hasCode(false)
+{
+}
+
+void QRDetectorContext::setStats(QRDetector::Stats* stats) {
+    this->stats = stats;
+}
+
+void QRDetectorContext::setFailure(QRDetector::Failure failure) {
+    lastFailure = failure;
+    if(stats)
+        stats->failure = failure;
+}
+
+void QRDetectorContext::setDebugImage(const char* name, const cv::Mat& image) {
+    for(DebugImage& debugImage : debugOutput) {
+        if(std::strcmp(debugImage.first, name) == 0) {
+            debugImage.second = image;
+            return;
+        }
+    }
+    debugOutput.push_back(DebugImage(name, image));
+}
+
+void QRDetectorContext::setCode(const QRDetector::QRCode* code, double scale, const cv::Point2f& offset) {
+    hasCode = (code != nullptr);
+    if(!code)
+        return;
+
+    // The code may be the recorded one, being mapped once more.
+    if(code != &resultCode)
+        resultCode = *code;
+
+    const float factor = static_cast<float>(scale);
+    resultCode.a = resultCode.a * factor + offset;
+    resultCode.b = resultCode.b * factor + offset;
+    resultCode.c = resultCode.c * factor + offset;
+    resultCode.d = resultCode.d * factor + offset;
+    for(std::vector<cv::Point>& pattern : resultCode.patterns) {
+        for(cv::Point& point : pattern)
+            point = cv::Point(cvRound(point.x * factor + offset.x), cvRound(point.y * factor + offset.y));
+    }
+    resultCode.moduleSize *= factor;
+}
+
+QRDetector::Config::Config()
+    : cannyLowerThreshold(CANNY_LOWER_THRESHOLD)
+    , cannyUpperThreshold(CANNY_UPPER_THRESHOLD)
+    , medianBlurNeighbourhood(MEDIAN_BLUR_NEIGHBOURHOOD)
+    , binaryThreshold(BINARY_THRESHOLD)
+    , simplificationStartEpsilon(SIMPLFIICATION_START_EPSILON)
+    , maxAreaThreshold(MAX_AREA_THRESHOLD)
+    , adaptiveRadius(0)
+    , adaptiveSensitivity(ADAPTIVE_SENSITIVITY)
+    , prescreenDimension(PRESCREEN_DIMENSION)
+{
+}
+
+bool QRDetector::Config::valid() const {
+    return cannyLowerThreshold >= 0.0 && cannyLowerThreshold <= cannyUpperThreshold &&
+           medianBlurNeighbourhood > 1 && medianBlurNeighbourhood % 2 == 1 &&
+           binaryThreshold >= 0 && binaryThreshold < 255 &&
+           simplificationStartEpsilon > 0.0 && maxAreaThreshold > 0.0 &&
+           adaptiveRadius >= 0 && adaptiveSensitivity >= 0.0 && adaptiveSensitivity < 1.0 &&
+           prescreenDimension > 0;
+}
+
+QRDetector::QRDetector()
+    : fusedPreprocessing_(false)
+    , directSampling_(false)
+    , backend_(BACKEND_CONTOUR)
+    , binarization_(BINARIZATION_OTSU)
+    , threads_(1)
+    , prescreenMinRuns_(0)
+{
+}
+
+bool QRDetector::setConfig(const Config& config) {
+    if(!config.valid())
+        return false;
+
+    config_ = config;
+    return true;
+}
+
+void QRDetector::setBackend(Backend backend) {
+    backend_ = backend;
+}
+
+void QRDetector::setBinarization(Binarization binarization) {
+    binarization_ = binarization;
+}
+
+void QRDetector::setFusedPreprocessing(bool enabled) {
+    fusedPreprocessing_ = enabled;
+}
+
+void QRDetector::setDirectSampling(bool enabled) {
+    directSampling_ = enabled;
+}
+
+void QRDetector::setThreads(int threads) {
+    threads_ = std::max(1, threads);
+}
+
+void QRDetector::setPrescreen(int minRuns) {
+    prescreenMinRuns_ = std::max(0, minRuns);
+}
+
 cv::Mat QRDetector::detectQRCode(const cv::Mat& image, int debug) const {
+    QRDetectorContext context;
+    return detectQRCode(image, context, debug);
+}
 
-    // We convert the input image into greyscale, making it easier to handle.
-    cv::Mat gray(image.size(), CV_8UC1);
-    cv::cvtColor(image, gray, CV_RGB2GRAY);
+cv::Mat QRDetector::detectQRCode(const cv::Mat& image, QRDetectorContext& context, int debug) const {
 
-    // Binarize and filter the grayscale image.
-    cv::medianBlur(gray, gray, MEDIAN_BLUR_NEIGHBOURHOOD);
-    cv::threshold(gray, gray, BINARY_THRESHOLD, 255, cv::THRESH_OTSU);
-    cv::medianBlur(gray, gray, MEDIAN_BLUR_NEIGHBOURHOOD);
+    // Return the first code being found, failed ones have been dropped already.
+    const std::vector<cv::Mat>& codes = detectQRCodes(image, context, debug);
+    if(codes.empty())
+        return cv::Mat();
+
+    return codes.front();
+}
+
+std::vector<cv::Mat> QRDetector::detectQRCodes(const cv::Mat& image, int debug) const {
+    QRDetectorContext context;
+    return detectQRCodes(image, context, debug);
+}
+
+const std::vector<cv::Mat>& QRDetector::detectQRCodes(const cv::Mat& image, QRDetectorContext& context, int debug) const {
+    context.setCode(nullptr);
+    if(!prescreen(image, context)) {
+        context.results.clear();
+        return context.results;
+    }
+
+    std::vector<QRCode>& codes = context.codes;
+    locateQRCodes(image, context, debug);
+    if(context.stats)
+        context.stats->scale = 1.0;
+
+    // Normalize each code into its own result buffer. Codes which cannot be sampled
+    // are dropped, such that codes and results stay aligned and none is empty.
+    context.results.resize(codes.size());
+    int found = 0;
+    for(int i=0; i<codes.size(); i++) {
+        sampleQRCode(image, context.gray, codes[i], context, context.results[found], debug);
+        if(context.results[found].empty())
+            continue;
+        if(found != i)
+            std::swap(codes[found], codes[i]);
+        found++;
+    }
+
+    // The failure of locating is kept, if nothing has been sampled at all.
+    if(!codes.empty())
+        context.setFailure(found > 0 ? FAILURE_NONE : FAILURE_SAMPLING);
+    codes.resize(found);
+    context.results.resize(found);
+    if(found > 0)
+        context.setCode(&codes.front());
+
+    // Return the normalized results.
+    return context.results;
+}
+
+cv::Mat QRDetector::sampleQRCode(const cv::Mat& image, QRCode& code, int debug) const {
+    QRDetectorContext context;
+    return sampleQRCode(image, code, context, debug);
+}
+
+cv::Mat QRDetector::sampleQRCode(const cv::Mat& image, QRCode& code, QRDetectorContext& context, int debug) const {
+    context.results.resize(1);
+    sampleQRCode(image, cv::Mat(), code, context, context.results.front(), debug);
+
+    return context.results.front();
+}
+
+bool QRDetector::sampleQRCode(const cv::Mat& image, QRCode& code, QRDetectorContext& context, BitMatrix& bits) const {
+    context.results.resize(1);
+    sampleLocatedCode(image, cv::Mat(), code, context, context.results.front(), DEBUG_NONE, &bits);
+
+    context.setFailure(bits.empty() ? FAILURE_SAMPLING : FAILURE_NONE);
+
+    return !bits.empty();
+}
+
+void QRDetector::sampleLocatedCode(const cv::Mat& image, const cv::Mat& binary, QRCode& code, QRDetectorContext& context, cv::Mat& result, int debug, BitMatrix* bits) const {
+
+    // Sample the modules right inside the binary image, unless the aligned image is requested.
+    if(directSampling_ && !(debug & DEBUG_ALIGNED)) {
+        if(!binary.empty()) {
+            {
+                StageTimer timer(context.stats, STAGE_ALIGN);
+                refineAlignment(binary, cv::Point(0, 0), code, context);
+            }
+            StageTimer timer(context.stats, STAGE_NORMALIZE);
+            sampleGrid(binary, cv::Point(0, 0), code, result, context, bits);
+            return;
+        }
+
+        // Binarize only the code's region, instead of the whole image.
+        std::vector<cv::Point>& corners = context.scaledCorners;
+        corners.resize(4);
+        corners[0] = code.a;
+        corners[1] = code.b;
+        corners[2] = code.c;
+        corners[3] = code.d;
+        cv::Rect roi = cv::boundingRect(corners);
+        roi &= cv::Rect(0, 0, image.cols, image.rows);
+        if(roi.area() <= 0) {
+            result.release();
+            if(bits)
+                bits->release();
+            return;
+        }
+
+        binarize(image(roi), context.gray, context);
+        {
+            StageTimer timer(context.stats, STAGE_ALIGN);
+            refineAlignment(context.gray, roi.tl(), code, context);
+        }
+        StageTimer timer(context.stats, STAGE_NORMALIZE);
+        sampleGrid(context.gray, roi.tl(), code, result, context, bits);
+        return;
+    }
+
+    // Align code, using the alignment pattern if the binary image is at hand.
+    // Locally thresholded images are warped as they are, instead of being thresholded globally again.
+    {
+        StageTimer timer(context.stats, STAGE_ALIGN);
+        if(!binary.empty())
+            refineAlignment(binary, cv::Point(0, 0), code, context);
+        const bool adaptive = binarization_ != BINARIZATION_OTSU && !binary.empty();
+        alignQRCode(adaptive ? binary : image, code, context.aligned, context);
+    }
+
+    // Normalize code.
+    {
+        StageTimer timer(context.stats, STAGE_NORMALIZE);
+        normalizeQRCode(context.aligned, code, result, context);
+        if(bits)
+            bits->fromMat(result);
+    }
+
+    if(debug & DEBUG_ALIGNED)
+        context.setDebugImage("aligned", context.aligned);
+}
+
+void QRDetector::sampleQRCode(const cv::Mat& image, const cv::Mat& binary, QRCode& code, QRDetectorContext& context, cv::Mat& result, int debug) const {
+    sampleLocatedCode(image, binary, code, context, result, debug);
+
+    context.setFailure(result.empty() ? FAILURE_SAMPLING : FAILURE_NONE);
+}
+
+cv::Mat QRDetector::detectQRCode(const ImageView& view, QRDetectorContext& context, int debug) const {
+    return detectQRCode(view.toMat(context.luma), context, debug);
+}
+
+cv::Mat QRDetector::detectQRCodeScaled(const ImageView& view, QRDetectorContext& context, int debug) const {
+    return detectQRCodeScaled(view.toMat(context.luma), context, debug);
+}
+
+cv::Mat QRDetector::detectQRCodeScaled(const cv::Mat& image, int debug) const {
+    QRDetectorContext context;
+    return detectQRCodeScaled(image, context, debug);
+}
+
+cv::Mat QRDetector::detectQRCodeScaled(const cv::Mat& image, QRDetectorContext& context, int debug) const {
+    context.setCode(nullptr);
+    if(!prescreen(image, context))
+        return cv::Mat();
+
+    cv::Mat result;
+    if(searchPyramid(image, context, debug, result))
+        return result;
+
+    // Small codes might not survive downscaling, so finally try the original image.
+    int numMarkers = 0;
+    std::vector<QRCode>& located = context.codes;
+    locateQRCodes(image, context, debug, &numMarkers);
+    if(context.stats)
+        context.stats->scale = 1.0;
+    context.results.resize(1);
+    for(QRCode& code : located) {
+        sampleQRCode(image, context.gray, code, context, context.results.front(), debug);
+        if(!context.results.front().empty()) {
+            context.setCode(&code);
+            return context.results.front();
+        }
+    }
+
+    return searchUpscaled(image, numMarkers, context, debug);
+}
+
+cv::Mat QRDetector::detectQRCodeRescaled(const cv::Mat& image, int numMarkers, QRDetectorContext& context, int debug) const {
+    context.setCode(nullptr);
+    cv::Mat result;
+    if(searchPyramid(image, context, debug, result))
+        return result;
+
+    return searchUpscaled(image, numMarkers, context, debug);
+}
+
+bool QRDetector::searchPyramid(const cv::Mat& image, QRDetectorContext& context, int debug, cv::Mat& result) const {
+
+    // Build the pyramid once, each level halving the resolution. The original image
+    // is level 0 and not being stored, such that the context does not keep it alive.
+    std::vector<cv::Mat>& pyramid = context.pyramid;
+    int levels = 1;
+    while(true) {
+        const cv::Mat& previous = (levels == 1) ? image : pyramid[levels - 2];
+        if(std::min(previous.rows, previous.cols) / 2 < PYRAMID_MIN_DIMENSION)
+            break;
+        if(pyramid.size() < levels)
+            pyramid.resize(levels);
+        cv::pyrDown((levels == 1) ? image : pyramid[levels - 2], pyramid[levels - 1]);
+        levels++;
+    }
+
+    // Search from coarse to fine, the first hit tells where the code is located.
+    for(int l = levels - 1; l > 0; l--) {
+        const cv::Mat& level = pyramid[l - 1];
+        // Since refinement reuses the context, the coarse codes need to be kept aside.
+        std::vector<QRCode>& coarse = context.coarse;
+        coarse = locateQRCodes(level, context, debug);
+        const double scale = static_cast<double>(image.cols) / level.cols;
+        for(QRCode& code : coarse) {
+
+            // Refine inside the code's region at full resolution.
+            result = refineQRCode(image, code, scale, context, debug);
+            if(!result.empty())
+                return true;
+
+            // Refinement failed, so try what we got on the coarse level.
+            if(context.stats)
+                context.stats->scale = scale;
+            result = sampleQRCode(level, code, context, debug);
+            if(!result.empty()) {
+                context.setCode(&code, scale);
+                return true;
+            }
+        }
+
+        // Only false positives so far, so go on with the finer levels.
+    }
+
+    result.release();
+    return false;
+}
+
+cv::Mat QRDetector::searchUpscaled(const cv::Mat& image, int numMarkers, QRDetectorContext& context, int debug) const {
+
+    // Upscaling is expensive and only promising, if at least a marker has been seen.
+    if(numMarkers > 0 && std::min(image.rows, image.cols) < UPSCALE_MIN_DIMENSION) {
+        double scale = static_cast<double>(UPSCALE_MIN_DIMENSION) / std::min(image.rows, image.cols);
+        cv::resize(image, context.upscaled, cv::Size(), scale, scale, cv::INTER_CUBIC);
+        cv::Mat result = detectQRCode(context.upscaled, context, debug);
+        if(context.stats)
+            context.stats->scale = 1.0 / scale;
+        if(context.hasCode)
+            context.setCode(&context.resultCode, 1.0 / scale);
+        return result;
+    }
+
+    return cv::Mat();
+}
+
+bool QRDetector::prescreen(const cv::Mat& image, QRDetectorContext& context) const {
+    if(prescreenMinRuns_ <= 0)
+        return true;
+
+    StageTimer timer(context.stats, STAGE_PREPROCESS);
+
+    // Subsample instead of averaging, such that only the thumbnail's pixels are read.
+    cv::Mat thumbnail = image;
+    const double factor = static_cast<double>(config_.prescreenDimension) / std::max(image.rows, image.cols);
+    if(factor < 1.0) {
+        cv::resize(image, context.thumbnail, cv::Size(), factor, factor, cv::INTER_NEAREST);
+        thumbnail = context.thumbnail;
+    }
+    if(thumbnail.channels() != 1) {
+        cv::cvtColor(thumbnail, context.binaryThumbnail, CV_RGB2GRAY);
+        thumbnail = context.binaryThumbnail;
+    }
+
+    // A global threshold fails on codes next to large dark surfaces or printed in gray,
+    // while the contrast required locally keeps noise and faint texture light.
+    cv::adaptiveThreshold(thumbnail, context.binaryThumbnail, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY,
+                          PRESCREEN_BLOCK_SIZE, PRESCREEN_CONTRAST);
+
+    if(context.scanner.countRuns(context.binaryThumbnail, prescreenMinRuns_) >= prescreenMinRuns_)
+        return true;
+
+    context.setFailure(FAILURE_PRESCREEN);
+    return false;
+}
+
+cv::Mat QRDetector::refineQRCode(const cv::Mat& image, const QRCode& coarse, double scale, QRDetectorContext& context, int debug) const {
+
+    // Estimate module size in full resolution, using the marker's area.
+    double moduleSize = 0.0;
+    for(const std::vector<cv::Point>& pattern : coarse.patterns)
+        moduleSize += std::sqrt(cv::contourArea(pattern)) / 7.0; // modules/marker
+    moduleSize *= scale / coarse.patterns.size();
+
+    // Region of interest, including quiet zone and some tolerance for the coarse corners.
+    std::vector<cv::Point>& corners = context.scaledCorners;
+    corners.resize(4);
+    corners[0] = coarse.a * scale;
+    corners[1] = coarse.b * scale;
+    corners[2] = coarse.c * scale;
+    corners[3] = coarse.d * scale;
+    int margin = static_cast<int>(std::ceil(REFINEMENT_MARGIN * moduleSize + scale));
+    cv::Rect roi = cv::boundingRect(corners);
+    roi = cv::Rect(roi.x - margin, roi.y - margin, roi.width + 2 * margin, roi.height + 2 * margin);
+    roi &= cv::Rect(0, 0, image.cols, image.rows);
+    if(roi.area() <= 0)
+        return cv::Mat();
+
+    // Very small modules get upscaled.
+    cv::Mat region = image(roi);
+    double factor = 1.0;
+    if(moduleSize < REFINEMENT_MIN_MODULE_SIZE) {
+        factor = REFINEMENT_MIN_MODULE_SIZE / moduleSize;
+        cv::resize(image(roi), context.upscaled, cv::Size(), factor, factor, cv::INTER_CUBIC);
+        region = context.upscaled;
+    }
+
+    std::vector<QRCode>& located = context.codes;
+    locateQRCodes(region, context, debug);
+    if(context.stats)
+        context.stats->scale = 1.0 / factor;
+    context.results.resize(1);
+    for(QRCode& code : located) {
+        sampleQRCode(region, context.gray, code, context, context.results.front(), debug);
+        if(!context.results.front().empty()) {
+            context.setCode(&code, 1.0 / factor, roi.tl());
+            return context.results.front();
+        }
+    }
+
+    return cv::Mat();
+}
+
+std::vector<QRDetector::QRCode> QRDetector::locateQRCodes(const cv::Mat& image, int debug, int* numMarkers) const {
+    QRDetectorContext context;
+    return locateQRCodes(image, context, debug, numMarkers);
+}
+
+const std::vector<QRDetector::QRCode>& QRDetector::locateQRCodes(const cv::Mat& image, QRDetectorContext& context, int debug, int* numMarkers) const {
+
+    // Convert into a filtered binary image.
+    binarize(image, context.gray, context);
+
+    // Split large images into about as many tiles as there are threads.
+    int columns = 1, rows = 1;
+    const int maxColumns = context.gray.cols / TILING_MIN_SIZE, maxRows = context.gray.rows / TILING_MIN_SIZE;
+    while(columns * rows < threads_ && (columns < maxColumns || rows < maxRows)) {
+        if(rows >= maxRows || (columns < maxColumns && context.gray.cols / columns >= context.gray.rows / rows))
+            columns++;
+        else
+            rows++;
+    }
+    bool tiled = (backend_ != BACKEND_SCANLINE) && (columns * rows > 1);
+
+    // Find the marker candidates using the selected backend, and assign them to the codes
+    // they belong to. Markers larger than the overlap of the tiles are lost, so the whole
+    // image is searched once more, if the tiles do not yield a single code.
+    std::vector<std::vector<cv::Point>>& markers = context.markers;
+    std::vector<std::vector<cv::Point>>& contourCandidates = context.candidates;
+    while(true) {
+        if(backend_ == BACKEND_SCANLINE) {
+            StageTimer timer(context.stats, STAGE_CONTOURS);
+            context.scanner.findCenters(context.gray, context.scannerCenters);
+            context.scanner.extractContours(context.gray, context.scannerCenters, markers);
+        } else if(tiled) {
+            findMarkerContoursTiled(context, columns, rows);
+        } else {
+            findMarkerContours(context);
+        }
+        if(context.stats)
+            context.stats->markers += static_cast<int>(markers.size());
+
+        // Simplify the retrieved contours, before grouping them.
+        context.groups.clear();
+        if(markers.size() >= 3) {
+            StageTimer timer(context.stats, STAGE_FILTER);
+            contourCandidates.resize(markers.size());
+            for(int i=0; i<markers.size(); i++) {
+                int iterations = simplifyContour(markers[i], 4, contourCandidates[i], context);
+                if(context.stats)
+                    context.stats->simplifyIterations += iterations;
+            }
+            groupPatterns(context);
+        }
+
+        if(!tiled || !context.groups.empty())
+            break;
+        tiled = false;
+    }
+
+    if(numMarkers)
+        *numMarkers = static_cast<int>(markers.size());
+
+    // Do not continue, if less than three markers have been found.
+    std::vector<QRCode>& codes = context.codes;
+    if(markers.size() < 3) {
+        context.setFailure(FAILURE_NO_MARKERS);
+        codes.clear();
+        return codes;
+    }
+
+    // Create inpainting image and draw the contours being found, only if it is going to be shown.
+    cv::Mat* augmented = nullptr;
+    if(debug & DEBUG_AUGMENTED) {
+        if(image.channels() == 1)
+            cv::cvtColor(image, context.augmented, CV_GRAY2BGR);
+        else
+            image.copyTo(context.augmented);
+        augmented = &context.augmented;
+        cv::drawContours(*augmented, contourCandidates, -1, cv::Scalar(0, 0, 255), 2, 8);
+    }
+
+    // Locate each code.
+    {
+        StageTimer timer(context.stats, STAGE_EXTRACT);
+        codes.resize(context.groups.size());
+        context.patterns.resize(3);
+        for(int g=0; g<context.groups.size(); g++) {
+            for(int i=0; i<3; i++)
+                context.patterns[i] = contourCandidates[context.groups[g][i]];
+
+            extractQRCode(context.patterns, codes[g], context, augmented);
+        }
+    }
 
-    // Apply the Canny operator and store the result in a new image.
-    cv::Mat edgeMap;
-    cv::Canny(gray, edgeMap, CANNY_LOWER_THRESHOLD , CANNY_UPPER_THRESHOLD);
+    if(context.stats)
+        context.stats->codes += static_cast<int>(codes.size());
+    context.setFailure(codes.empty() ? FAILURE_NO_CODE : FAILURE_NONE);
 
-    // Detect contours inside the edge map and store their hierarchy.
-    std::vector<std::vector<cv::Point> > contours;
-    std::vector<cv::Vec4i> hierarchy;
-    cv::findContours(edgeMap, contours, hierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+    //---- Debug output begin
+    if(debug & DEBUG_BINARY)    context.setDebugImage("gray", context.gray);
+    if((debug & DEBUG_EDGE) && backend_ != BACKEND_SCANLINE && !tiled) context.setDebugImage("edge", context.edgeMap);
+    if(augmented) context.setDebugImage("input", *augmented);
+    //---- Debug output end
+
+    return codes;
+}
+
+void QRDetector::findMarkerContours(QRDetectorContext& context) const {
+    std::vector<std::vector<cv::Point> >& contours = context.contours;
+    std::vector<cv::Vec4i>& hierarchy = context.hierarchy;
+    {
+        StageTimer timer(context.stats, STAGE_CONTOURS);
+
+        // Apply the Canny operator and store the result in the edge map.
+        cv::Canny(context.gray, context.edgeMap, config_.cannyLowerThreshold, config_.cannyUpperThreshold);
+
+        // Detect contours inside the edge map and store their hierarchy.
+        cv::findContours(context.edgeMap, contours, hierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
+    }
+    if(context.stats)
+        context.stats->contours += static_cast<int>(contours.size());
+
+    StageTimer timer(context.stats, STAGE_FILTER);
+    std::vector<int>& positionCandidates = context.positionCandidates;
+    filterMarkerContours(contours, hierarchy, positionCandidates);
+
+    // Return the contours of the candidates.
+    std::vector<std::vector<cv::Point>>& markers = context.markers;
+    markers.resize(positionCandidates.size());
+    for(int i=0; i<positionCandidates.size(); i++)
+        markers[i] = contours[positionCandidates[i]];
+}
+
+void QRDetector::findMarkerContoursTiled(QRDetectorContext& context, int columns, int rows) const {
+    const cv::Mat& gray = context.gray;
+    const cv::Rect bounds(0, 0, gray.cols, gray.rows);
+    const int overlap = static_cast<int>(std::ceil(0.5 * TILING_MAX_MARKER_FRACTION * std::min(gray.cols, gray.rows)));
+
+    // Cores partition the image, the regions being searched overlap.
+    std::vector<QRDetectorContext::Tile>& tiles = context.tiles;
+    tiles.resize(columns * rows);
+    for(int r = 0; r < rows; r++) {
+        for(int c = 0; c < columns; c++) {
+            QRDetectorContext::Tile& tile = tiles[r * columns + c];
+            const int x0 = c * gray.cols / columns, x1 = (c + 1) * gray.cols / columns;
+            const int y0 = r * gray.rows / rows, y1 = (r + 1) * gray.rows / rows;
+            tile.core = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+            tile.roi = cv::Rect(x0 - overlap, y0 - overlap, x1 - x0 + 2 * overlap, y1 - y0 + 2 * overlap) & bounds;
+        }
+    }
+
+    // Tiles are handed to OpenCV's thread pool, one stripe each.
+    {
+        StageTimer timer(context.stats, STAGE_CONTOURS);
+        parallelFor(cv::Range(0, static_cast<int>(tiles.size())), [&](const cv::Range& range) {
+            for(int t = range.start; t < range.end; t++) {
+                QRDetectorContext::Tile& tile = tiles[t];
+                cv::Canny(gray(tile.roi), tile.edgeMap, config_.cannyLowerThreshold, config_.cannyUpperThreshold);
+                cv::findContours(tile.edgeMap, tile.contours, tile.hierarchy, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE, tile.roi.tl());
+                filterMarkerContours(tile.contours, tile.hierarchy, tile.positionCandidates);
+
+                // Markers seen by the neighbouring tiles as well are only taken from the one owning their center.
+                tile.positionCandidates.erase(std::remove_if(tile.positionCandidates.begin(), tile.positionCandidates.end(),
+                                                             [&](int i) {
+                                                                 cv::Rect box = cv::boundingRect(tile.contours[i]);
+                                                                 return !tile.core.contains(cv::Point(box.x + box.width / 2, box.y + box.height / 2));
+                                                             }),
+                                              tile.positionCandidates.end());
+            }
+        });
+    }
+
+    // Merge the candidates of all tiles, which are in image coordinates already.
+    StageTimer timer(context.stats, STAGE_FILTER);
+    std::vector<std::vector<cv::Point>>& markers = context.markers;
+    size_t count = 0;
+    for(const QRDetectorContext::Tile& tile : tiles) {
+        if(context.stats)
+            context.stats->contours += static_cast<int>(tile.contours.size());
+        count += tile.positionCandidates.size();
+    }
+    markers.resize(count);
+    count = 0;
+    for(const QRDetectorContext::Tile& tile : tiles) {
+        for(int i : tile.positionCandidates)
+            markers[count++] = tile.contours[i];
+    }
+}
+
+void QRDetector::filterMarkerContours(const std::vector<std::vector<cv::Point>>& contours, const std::vector<cv::Vec4i>& hierarchy, std::vector<int>& positionCandidates) const {
 
     // Loop through hierarchy and find each contour containing two other nested contours.
     double ratios[] = {1.0, 7.0/5.0, 1.0, 5.0/3.0, 1.0};
-    std::vector<int> positionCandidates;
+    positionCandidates.clear();
     for(int i=0; i<contours.size(); i++) {
         int children = 0;
         int level = hierarchy[i][2];
@@ -59,7 +871,7 @@ cv::Mat QRDetector::detectQRCode(const cv::Mat& image, int debug) const {
 
                 // Each child element needs to have the same area ratio.
                 double innerArea = cv::minAreaRect(contours[level]).size.area();
-                if(std::abs((outerArea / innerArea) - ratios[children]) > MAX_AREA_THRESHOLD)
+                if(std::abs((outerArea / innerArea) - ratios[children]) > config_.maxAreaThreshold)
                     break;
                 outerArea = innerArea;
 
@@ -77,66 +889,150 @@ cv::Mat QRDetector::detectQRCode(const cv::Mat& image, int debug) const {
                 positionCandidates.push_back(i);
         }
     }
+}
 
-    // Do not continue, if less than three markers have been found.
-    if(positionCandidates.size() < 3) {
-        return cv::Mat();
-    }
-
-    // Create inpainting image.
-    cv::Mat augmented = image.clone();
-
-    // Simplify the retrieved contours and draw debug visuals.
-    std::vector<std::vector<cv::Point>> contourCandidates;
-    for(int i : positionCandidates) {
+void QRDetector::groupPatterns(QRDetectorContext& context) const {
+    const std::vector<std::vector<cv::Point>>& patterns = context.candidates;
+    std::vector<cv::Vec3i>& groups = context.groups;
+    groups.clear();
 
-        // Simplify contour.
-        contours[i] = simplifyContour(contours[i], 4);
+    // Three markers are taken as they are, since there is nothing to choose from.
+    if(patterns.size() == 3) {
+        groups.push_back(cv::Vec3i(0, 1, 2));
+        return;
+    }
 
-        // Draw the contours being found.
-        cv::drawContours(augmented, contours, i, cv::Scalar(0, 0, 255), 2, 8);
+    // Determine center and module size of each marker.
+    std::vector<cv::Point2f>& centers = context.centers;
+    std::vector<double>& moduleSizes = context.moduleSizes;
+    centers.resize(patterns.size());
+    moduleSizes.resize(patterns.size());
+    for(int i = 0; i<patterns.size(); i++) {
+        cv::Moments m = cv::moments(patterns[i], false);
+        centers[i] = cv::Point2f(static_cast<float>(m.m10/m.m00), static_cast<float>(m.m01/m.m00));
+        moduleSizes[i] = std::sqrt(cv::contourArea(patterns[i])) / 7.0; // modules/marker
+    }
 
-        // Store candidate
-        contourCandidates.push_back(contours[i]);
+    // Rate each triple of markers, by how good they form the corners of a single code.
+    typedef QRDetectorContext::Triple Triple;
+    std::vector<Triple>& triples = context.triples;
+    triples.clear();
+    const int n = static_cast<int>(patterns.size());
+    for(int i = 0; i < n; i++) {
+        for(int j = i + 1; j < n; j++) {
+            for(int k = j + 1; k < n; k++) {
+
+                // All markers of a code share the same module size.
+                double minModule = std::min({moduleSizes[i], moduleSizes[j], moduleSizes[k]});
+                double maxModule = std::max({moduleSizes[i], moduleSizes[j], moduleSizes[k]});
+                if(minModule <= 0.0 || maxModule / minModule > GROUPING_MAX_RATIO)
+                    continue;
+                double moduleSize = (moduleSizes[i] + moduleSizes[j] + moduleSizes[k]) / 3.0;
+
+                // Try each marker as the one in the corner.
+                int indices[] = {i, j, k};
+                double bestScore = -1.0;
+                int bestCorner = -1;
+                for(int v = 0; v < 3; v++) {
+                    const cv::Point2f& corner = centers[indices[v]];
+                    cv::Point2f u = centers[indices[(v + 1) % 3]] - corner;
+                    cv::Point2f w = centers[indices[(v + 2) % 3]] - corner;
+                    double lu = cv::norm(u), lw = cv::norm(w);
+                    if(lu <= 0.0 || lw <= 0.0)
+                        continue;
+
+                    // Both legs need to be of same length and enclose a right angle.
+                    double cosine = std::abs(u.ddot(w) / (lu * lw));
+                    double ratio = std::max(lu, lw) / std::min(lu, lw);
+                    if(cosine > GROUPING_MAX_COSINE || ratio > GROUPING_MAX_RATIO)
+                        continue;
+
+                    // The distance between markers is limited by the code versions.
+                    double modules = (lu + lw) / (2.0 * moduleSize);
+                    if(modules < GROUPING_MIN_MODULES || modules > GROUPING_MAX_MODULES)
+                        continue;
+
+                    double score = cosine + (ratio - 1.0) + (maxModule / minModule - 1.0);
+                    if(bestCorner < 0 || score < bestScore) {
+                        bestScore = score;
+                        bestCorner = v;
+                    }
+                }
+                if(bestCorner < 0)
+                    continue;
+
+                // Markers of neighbouring codes are separated by the quiet zone, which
+                // shows up as a long light run in between.
+                const cv::Point2f& corner = centers[indices[bestCorner]];
+                if(longestLightRun(context.gray, corner, centers[indices[(bestCorner + 1) % 3]]) > GROUPING_MAX_LIGHT_RUN * moduleSize ||
+                   longestLightRun(context.gray, corner, centers[indices[(bestCorner + 2) % 3]]) > GROUPING_MAX_LIGHT_RUN * moduleSize)
+                    continue;
+
+                Triple triple = {{i, j, k}, bestScore};
+                triples.push_back(triple);
+            }
+        }
     }
 
-    // Don't continue, if more than 3 contour candidates have been found.
-    if(contourCandidates.size() > 3) {
-        std::cout << "More than 3 markers have been found! Only one QR Code is supported at a time." << std::endl;
-        return cv::Mat();
+    // Greedily take the best rated triples, each marker being used at most once.
+    std::sort(triples.begin(), triples.end(), [](const Triple& lhs, const Triple& rhs) { return lhs.score < rhs.score; });
+    std::vector<char>& used = context.used;
+    used.assign(patterns.size(), false);
+    for(const Triple& triple : triples) {
+        if(used[triple.markers[0]] || used[triple.markers[1]] || used[triple.markers[2]])
+            continue;
+
+        for(int m : triple.markers)
+            used[m] = true;
+        groups.push_back(cv::Vec3i(triple.markers[0], triple.markers[1], triple.markers[2]));
     }
+}
 
-    // Currently, only 1 qr code is supported at a time.
-    // This approach simply takes the first three markers, it can find.
-    QRCode code = extractQRCode(contourCandidates, augmented);
+void QRDetector::binarize(const cv::Mat& image, cv::Mat& gray, QRDetectorContext& context) const {
+    StageTimer timer(context.stats, STAGE_PREPROCESS);
 
-    // Align code.
-    cv::Mat imAligned = alignQRCode(image, code);
+    // Local thresholds replace the whole chain below.
+    if(binarization_ != BINARIZATION_OTSU && (image.type() == CV_8UC3 || image.type() == CV_8UC1)) {
+        const int radius = (config_.adaptiveRadius > 0) ? config_.adaptiveRadius
+                                                        : std::max(ADAPTIVE_MIN_RADIUS, std::min(image.cols, image.rows) / ADAPTIVE_RADIUS_DIVISOR);
+        adaptiveBinarize(image, gray, (binarization_ == BINARIZATION_SAUVOLA) ? ADAPTIVE_SAUVOLA : ADAPTIVE_BRADLEY,
+                         radius, static_cast<float>(config_.adaptiveSensitivity), context.binarizationBuffer);
+        return;
+    }
 
-    // Normalize code.
-    cv::Mat imNormalized = normalizeQRCode(imAligned, code);
+    // The fused kernel reproduces exactly the chain below, given a 3x3 median filter.
+    if(fusedPreprocessing_ && config_.medianBlurNeighbourhood == 3 && (image.type() == CV_8UC3 || image.type() == CV_8UC1)) {
+        fusedBinarize(image, gray, context.binarizationBuffer);
+        return;
+    }
 
-    //---- Debug output begin
-    if(debug & DEBUG_BINARY)    cv::imshow("gray", gray);
-    if(debug & DEBUG_EDGE)      cv::imshow("edge", edgeMap);
-    if(debug & DEBUG_ALIGNED)   cv::imshow("aligned", imAligned);
-    if(debug & DEBUG_AUGMENTED) cv::imshow("input", augmented);
-    //---- Debug output end
+    // We convert the input image into greyscale, making it easier to handle.
+    // Grayscale input is filtered right away, leaving the image untouched.
+    gray.create(image.size(), CV_8UC1);
+    if(image.channels() == 1) {
+        cv::medianBlur(image, gray, config_.medianBlurNeighbourhood);
+    } else {
+        cv::cvtColor(image, gray, CV_RGB2GRAY);
+        cv::medianBlur(gray, gray, config_.medianBlurNeighbourhood);
+    }
 
-    // Return the normalized result.
-    return imNormalized;
+    // Binarize and filter the grayscale image.
+    cv::threshold(gray, gray, config_.binaryThreshold, 255, cv::THRESH_OTSU);
+    cv::medianBlur(gray, gray, config_.medianBlurNeighbourhood);
 }
 
-QRDetector::QRCode QRDetector::extractQRCode(const std::vector<std::vector<cv::Point>>& patterns, cv::Mat& augmented) const {
+void QRDetector::extractQRCode(const std::vector<std::vector<cv::Point>>& patterns, QRCode& code, QRDetectorContext& context, cv::Mat* augmented) const {
     assert(patterns.size() == 3); // At this point, we must have three markers sorted out.
 
     // For each contour, calculate the center of mass.
-    std::vector<cv::Point2d> centerOfMass(patterns.size());
-    std::vector<cv::Point> corners;
+    cv::Point2d centerOfMass[3];
+    std::vector<cv::Point>& corners = context.corners;
+    corners.clear();
     for(int i = 0; i<patterns.size(); i++) {
         cv::Moments m = cv::moments(patterns[i], false);
         centerOfMass[i] = cv::Point2d(m.m10/m.m00 , m.m01/m.m00);
-        cv::circle(augmented, centerOfMass[i], 4, cv::Scalar(255, 255, 255), -1, 8, 0);
+        if(augmented)
+            cv::circle(*augmented, centerOfMass[i], 4, cv::Scalar(255, 255, 255), -1, 8, 0);
 
         // Add all vertices to the global square contour.
         for(int j=0; j<patterns[i].size(); j++)
@@ -144,7 +1040,7 @@ QRDetector::QRCode QRDetector::extractQRCode(const std::vector<std::vector<cv::P
     }
 
     // Find the corner just after the lower left marker, being determined by the longest distance.
-    int maxDist = distanceSQ(centerOfMass[0], centerOfMass[2]), dist;
+    float maxDist = distanceSQ(centerOfMass[0], centerOfMass[2]), dist;
     int idxC = (orientation(centerOfMass[0], centerOfMass[2], centerOfMass[1]) < 0) ? 0 : 2;
     if((dist = distanceSQ(centerOfMass[0], centerOfMass[1])) > maxDist) {
         maxDist = dist;
@@ -155,11 +1051,15 @@ QRDetector::QRCode QRDetector::extractQRCode(const std::vector<std::vector<cv::P
     }
 
     // Simplify contour to determine enclosing hull.
-    std::vector<std::vector<cv::Point>> hullContour(1);
-    std::vector<cv::Point>& hull = hullContour[0];
+    std::vector<cv::Point>& hull = context.hull;
     float epsilon;
-    hull = simplifyContour(corners, 5, &epsilon);
-    cv::drawContours(augmented, hullContour, 0, cv::Scalar(255, 0, 0), 2, 8, -1, 0);
+    int iterations = simplifyContour(corners, 5, hull, context, &epsilon);
+    if(context.stats)
+        context.stats->simplifyIterations += iterations;
+    if(augmented) {
+        std::vector<std::vector<cv::Point>> hullContour(1, hull);
+        cv::drawContours(*augmented, hullContour, 0, cv::Scalar(255, 0, 0), 2, 8, -1, 0);
+    }
 
     // Since the start point has been lost in the simplification process,
     // we need to determine the indices of the necessary points again.
@@ -179,41 +1079,111 @@ QRDetector::QRCode QRDetector::extractQRCode(const std::vector<std::vector<cv::P
     //assert(start >= 0);
     if(start == -1) start = 0; // HACK: even if unlikely, better continue working.
 
+    // Refine the corners to sub-pixel accuracy, the window covering half a module at most.
+    std::vector<cv::Point2f>& refined = context.refinedCorners;
+    refined.resize(5);
+    for(int i=0; i<5; i++)
+        refined[i] = hull[(start + i) % hull.size()];
+    const double moduleSize = std::sqrt(cv::contourArea(patterns[idxC])) / 7.0; // modules/marker
+    const int window = std::min(static_cast<int>(moduleSize / 2.0), CORNER_REFINEMENT_MAX_WINDOW);
+    if(window >= 1) {
+        cv::cornerSubPix(context.gray, refined, cv::Size(window, window), cv::Size(-1, -1),
+                         cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 10, 0.05));
+
+        // Corners, which drifted off the window, are reset to their hull vertex.
+        for(int i=0; i<5; i++) {
+            if(distanceSQ(refined[i], hull[(start + i) % hull.size()]) > window * window)
+                refined[i] = hull[(start + i) % hull.size()];
+        }
+    }
+
     // Get helper points.
-    cv::Point helpC = hull[(start + 0) % hull.size()];
-    cv::Point helpA = hull[(start + 1) % hull.size()];
+    const cv::Point2f& helpC = refined[0];
+    const cv::Point2f& helpA = refined[1];
 
-    // Build the QR code.
-    QRCode code;
-    code.a = hull[(start + 2) % hull.size()];
-    code.b = hull[(start + 3) % hull.size()];
-    code.c = hull[(start + 4) % hull.size()];
-    code.d = intersect(code.a, helpA, code.c, helpC);
+    // Build the QR code, completing a parallelogram if the edges do not intersect.
+    code.a = refined[2];
+    code.b = refined[3];
+    code.c = refined[4];
+    if(!intersect(code.a, helpA, code.c, helpC, code.d))
+        code.d = code.a + code.c - code.b;
 
     // Draw the selected corners for debug assessment.
-    cv::circle(augmented, code.a, 4, cv::Scalar(255, 0, 0), -1, 8, 0);
-    cv::circle(augmented, code.b, 4, cv::Scalar(0, 255, 0), -1, 8, 0);
-    cv::circle(augmented, code.c, 4, cv::Scalar(0, 0, 255), -1, 8, 0);
-    cv::circle(augmented, code.d, 4, cv::Scalar(255, 255, 255), -1, 8, 0);
+    if(augmented) {
+        cv::circle(*augmented, code.a, 4, cv::Scalar(255, 0, 0), -1, 8, 0);
+        cv::circle(*augmented, code.b, 4, cv::Scalar(0, 255, 0), -1, 8, 0);
+        cv::circle(*augmented, code.c, 4, cv::Scalar(0, 0, 255), -1, 8, 0);
+        cv::circle(*augmented, code.d, 4, cv::Scalar(255, 255, 255), -1, 8, 0);
+    }
 
     // Store patterns for later use.
     code.patterns = patterns;
-
-    // Done here.
-    return code;
 }
 
-cv::Mat QRDetector::alignQRCode(const cv::Mat& image, QRCode& code) const {
+void QRDetector::sampleGrid(const cv::Mat& binary, const cv::Point& offset, QRCode& code, cv::Mat& result, QRDetectorContext& context, BitMatrix* bits) const {
+    assert(binary.type() == CV_8UC1);
 
-    // Choose size such that no data gets lost during transformation.
-    const float size = std::ceil(std::sqrt(std::max({distanceSQ(code.a, code.b),
-                                                     distanceSQ(code.b, code.c),
-                                                     distanceSQ(code.c, code.d),
-                                                     distanceSQ(code.d, code.a)}))
-                                 );
-    cv::Mat result(static_cast<int>(size), static_cast<int>(size), image.type());
+    // Use the same geometry as the aligned image, without actually warping it.
+    const float size = alignedSize(code);
+    cv::Point2f srcQuad[] = {code.a, code.b, code.c, code.d};
+    cv::Point2f dstQuad[] = {
+            {0.0f,  size},
+            {0.0f,  0.0f},
+            {size,  0.0f},
+            {size,  size},
+    };
+    estimateModuleSize(code, cv::getPerspectiveTransform(srcQuad, dstQuad), context);
+
+    // Determine code size, the same way as normalizeQRCode does.
+    const int rows = static_cast<int>(size);
+    int n = static_cast<int>(std::round((rows / code.moduleSize - 17) / 4.0f)) * 4 + 17;
+    if(n <= 0) {
+        result.release();
+        if(bits)
+            bits->release();
+        return;
+    }
+    float moduleSize = static_cast<float>(rows) / n;
 
-    // Define source and target vertices.
+    // Map the pixel holding each module's center in the aligned image back into the binary image.
+    cv::Mat sampleMat = cv::getPerspectiveTransform(dstQuad, srcQuad);
+    double h[9];
+    for(int i=0; i<9; i++)
+        h[i] = sampleMat.at<double>(i / 3, i % 3);
+
+    // In case cells are big enough, take neighbourhood into account.
+    const int k = (moduleSize > 3.0f) ? 1 : 0;
+
+    // Either one byte per module, or one bit per module being packed into words of each row.
+    if(bits) {
+        bits->create(n);
+        result.release();
+    } else {
+        result.create(n, n, CV_8UC1);
+    }
+    for(int r=0; r<n; r++) {
+        uchar* row = bits ? nullptr : result.ptr(r);
+        uint64_t* words = bits ? bits->row(r) : nullptr;
+        const double v = static_cast<int>(moduleSize * (r + 0.5f));
+        for(int c=0; c<n; c++) {
+            const double u = static_cast<int>(moduleSize * (c + 0.5f));
+            const double w = h[6] * u + h[7] * v + h[8];
+            int x = cvRound((h[0] * u + h[1] * v + h[2]) / w) - offset.x;
+            int y = cvRound((h[3] * u + h[4] * v + h[5]) / w) - offset.y;
+            const uchar value = k ? sampleModule<1>(binary, x, y, config_.binaryThreshold) : sampleModule<0>(binary, x, y, config_.binaryThreshold);
+            if(words)
+                words[c >> 6] |= static_cast<uint64_t>(value == 0) << (c & 63);
+            else
+                row[c] = value;
+        }
+    }
+}
+
+bool QRDetector::refineAlignment(const cv::Mat& binary, const cv::Point& offset, QRCode& code, QRDetectorContext& context) const {
+    assert(binary.type() == CV_8UC1);
+
+    // Determine the code size, the same way as sampleGrid does.
+    const float size = alignedSize(code);
     cv::Point2f srcQuad[] = {code.a, code.b, code.c, code.d};
     cv::Point2f dstQuad[] = {
             {0.0f,  size},
@@ -221,16 +1191,86 @@ cv::Mat QRDetector::alignQRCode(const cv::Mat& image, QRCode& code) const {
             {size,  0.0f},
             {size,  size},
     };
+    estimateModuleSize(code, cv::getPerspectiveTransform(srcQuad, dstQuad), context);
+    const int n = static_cast<int>(std::round((size / code.moduleSize - 17) / 4.0f)) * 4 + 17;
+    if(n < 25) // Version 1 does not have any alignment pattern.
+        return false;
+    const double pitch = static_cast<double>(size) / n;
+
+    // Maps a point of the aligned image into the image.
+    cv::Mat sampleMat = cv::getPerspectiveTransform(dstQuad, srcQuad);
+    double h[9];
+    for(int i=0; i<9; i++)
+        h[i] = sampleMat.at<double>(i / 3, i % 3);
+    auto map = [&](double u, double v) {
+        const double w = h[6] * u + h[7] * v + h[8];
+        return cv::Point2d((h[0] * u + h[1] * v + h[2]) / w, (h[3] * u + h[4] * v + h[5]) / w);
+    };
 
-    // Transform image.
-    cv::Mat warpMat = cv::getPerspectiveTransform(srcQuad, dstQuad);
-    cv::warpPerspective(image, result, warpMat, result.size());
+    // The bottom right alignment pattern is centered 6.5 modules away from the right and the bottom edge.
+    // Slide a 5x5 template of it across the surrounding, taking the centroid of all best matches.
+    const double expected = pitch * (n - 6.5);
+    const double step = std::max(0.25 * pitch, 1.0);
+    const int steps = static_cast<int>(ALIGNMENT_SEARCH_RADIUS * pitch / step);
+    int bestScore = ALIGNMENT_MIN_SCORE - 1, matches = 0;
+    cv::Point2d center;
+    for(int sy=-steps; sy<=steps; sy++) {
+        for(int sx=-steps; sx<=steps; sx++) {
+            const double u0 = expected + sx * step, v0 = expected + sy * step;
+            int score = 0;
+            for(int j=-2; j<=2; j++) {
+                for(int i=-2; i<=2; i++) {
+                    cv::Point2d p = map(u0 + i * pitch, v0 + j * pitch);
+                    int x = cvRound(p.x) - offset.x, y = cvRound(p.y) - offset.y;
+                    if(x < 0 || y < 0 || x >= binary.cols || y >= binary.rows)
+                        continue;
+
+                    // Dark outer ring and center, light inner ring.
+                    bool dark = binary.at<uchar>(y, x) <= config_.binaryThreshold;
+                    if(dark == (std::max(std::abs(i), std::abs(j)) != 1))
+                        score++;
+                }
+            }
+
+            if(score > bestScore) {
+                bestScore = score;
+                center = cv::Point2d(u0, v0);
+                matches = 1;
+            } else if(score == bestScore && matches > 0) {
+                center += cv::Point2d(u0, v0);
+                matches++;
+            }
+        }
+    }
+    if(matches == 0)
+        return false;
+    center *= 1.0 / matches;
+
+    // Replace the estimated corner by the one implied by the alignment pattern.
+    cv::Point2d alignment = map(center.x, center.y);
+    cv::Point2f srcRefined[] = {code.a, code.b, code.c, cv::Point2f(static_cast<float>(alignment.x), static_cast<float>(alignment.y))};
+    cv::Point2f dstRefined[] = {
+            {0.0f,  size},
+            {0.0f,  0.0f},
+            {size,  0.0f},
+            {static_cast<float>(expected),  static_cast<float>(expected)},
+    };
+    sampleMat = cv::getPerspectiveTransform(dstRefined, srcRefined);
+    for(int i=0; i<9; i++)
+        h[i] = sampleMat.at<double>(i / 3, i % 3);
+    cv::Point2d d = map(size, size);
+    code.d = cv::Point2f(static_cast<float>(d.x), static_cast<float>(d.y));
+    return true;
+}
+
+void QRDetector::estimateModuleSize(QRCode& code, const cv::Mat& warpMat, QRDetectorContext& context) const {
 
     // Determine cell size in image space.
     float s = 0;
     for(int i=0; i<code.patterns.size(); i++) {
         // 1. Convert vertices to floating point.
-        std::vector<cv::Point2f> transformed(4);
+        std::vector<cv::Point2f>& transformed = context.transformed;
+        transformed.assign(4, cv::Point2f());
         for(int j=0; j<code.patterns[i].size(); j++) {
             transformed[j] = code.patterns[i][j];
         }
@@ -243,62 +1283,113 @@ cv::Mat QRDetector::alignQRCode(const cv::Mat& image, QRCode& code) const {
         s += size.width + size.height;
     }
     code.moduleSize = s / (7 * 3 * 2); // modules/marker * marker * box sides
+}
+
+void QRDetector::alignQRCode(const cv::Mat& image, QRCode& code, cv::Mat& result, QRDetectorContext& context) const {
 
-    return result;
+    // Choose size such that no data gets lost during transformation.
+    const float size = alignedSize(code);
+    result.create(static_cast<int>(size), static_cast<int>(size), image.type());
+
+    // Define source and target vertices.
+    cv::Point2f srcQuad[] = {code.a, code.b, code.c, code.d};
+    cv::Point2f dstQuad[] = {
+            {0.0f,  size},
+            {0.0f,  0.0f},
+            {size,  0.0f},
+            {size,  size},
+    };
+
+    // Transform image.
+    cv::Mat warpMat = cv::getPerspectiveTransform(srcQuad, dstQuad);
+    cv::warpPerspective(image, result, warpMat, result.size());
+
+    // Determine cell size in image space.
+    estimateModuleSize(code, warpMat, context);
 }
 
-cv::Mat QRDetector::normalizeQRCode(const cv::Mat& image, const QRCode& code) const {
+void QRDetector::normalizeQRCode(const cv::Mat& image, const QRCode& code, cv::Mat& result, QRDetectorContext& context) const {
 
     // First, convert into binary image.
-    cv::Mat binary;
-    cv::cvtColor(image, binary, CV_RGB2GRAY);
-    cv::threshold(binary, binary, BINARY_THRESHOLD, 255, cv::THRESH_OTSU);
+    cv::Mat& binary = context.binaryAligned;
+    if(image.channels() == 1) {
+        cv::threshold(image, binary, config_.binaryThreshold, 255, cv::THRESH_OTSU);
+    } else {
+        cv::cvtColor(image, binary, CV_RGB2GRAY);
+        cv::threshold(binary, binary, config_.binaryThreshold, 255, cv::THRESH_OTSU);
+    }
 
     // Determine code size. Since the code has 17 + n * 4 modules per dimension, the approximation gets more accurat.
     int size = static_cast<int>(std::round((image.rows / code.moduleSize - 17) / 4.0f)) * 4 + 17;
     //int size = countColorSwitch(binary, cv::Point(code.moduleSize*0.5f, code.moduleSize*6.5f), cv::Point(image.rows-code.moduleSize*0.5f, code.moduleSize*6.5f)) - 1 + 14;
-    float moduleSize = static_cast<float>(image.rows) / size;
-
-    cv::Mat final = cv::Mat::zeros(size, size, CV_8UC1);
-    for(int r=0; r<size; r++) {
-        for(int c=0; c<size; c++) {
-
-            // Sample point in the middle of a module.
-            int x = static_cast<int>(moduleSize * (r + 0.5f));
-            int y = static_cast<int>(moduleSize * (c + 0.5f));
-
-            // In case cells are big enough, take neighbourhood into account.
-            if(moduleSize > 3.0f) {
-                final.at<uchar>(r, c) = pickMeanPixel(binary, cv::Point(x, y), 1);
-            // Otherwise, pick a single pixel.
-            } else {
-                if(binary.at<uchar>(x, y) > BINARY_THRESHOLD)
-                    final.at<uchar>(r, c) = 255;
-            }
-        }
+    if(size <= 0 || image.rows != image.cols) {
+        result.release();
+        return;
     }
+    float moduleSize = static_cast<float>(image.rows) / size;
 
-    return final;
+    // Sample point in the middle of a module, being the same for rows and columns.
+    std::vector<int>& centers = context.sampleCenters;
+    centers.resize(size);
+    for(int i=0; i<size; i++)
+        centers[i] = static_cast<int>(moduleSize * (i + 0.5f));
+
+    // In case cells are big enough, take neighbourhood into account. Otherwise, pick a single pixel.
+    result.create(size, size, CV_8UC1);
+    if(moduleSize > 3.0f)
+        sampleAlignedGrid<1>(binary, centers, config_.binaryThreshold, result);
+    else
+        sampleAlignedGrid<0>(binary, centers, config_.binaryThreshold, result);
 }
 
-std::vector<cv::Point> QRDetector::simplifyContour(const std::vector<cv::Point>& contour, int numPoints, float* const eps) const {
-    std::vector<cv::Point> simple = contour;
+int QRDetector::simplifyContour(const std::vector<cv::Point>& contour, int numPoints, std::vector<cv::Point>& simple, QRDetectorContext& context, float* const eps) const {
+    std::vector<cv::Point>& hull = context.convexHull;
+    std::vector<cv::Point>& trial = context.simplified;
 
     // Convex hull for a first approx result.
-    cv::convexHull(contour, simple, false);
+    cv::convexHull(contour, hull, false);
+    double epsilon = config_.simplificationStartEpsilon;
+    int iterations = 0;
+    if(hull.size() <= numPoints) {
+        simple.assign(hull.begin(), hull.end());
+        if(eps)
+            *eps = static_cast<float>(epsilon);
+        return iterations;
+    }
 
-    // Simplify further, until the desired amount of corners has been extracted.
-    double epsilon = SIMPLFIICATION_START_EPSILON;
-    while(simple.size() > numPoints) {
-        cv::approxPolyDP(simple, simple, epsilon, true);
-        epsilon += 1.0;
+    // Double the epsilon, until the desired amount of corners has been extracted.
+    double lower = 0.0;
+    for(;;) {
+        cv::approxPolyDP(hull, trial, epsilon, true);
+        iterations++;
+        if(trial.size() <= numPoints)
+            break;
+        lower = epsilon;
+        epsilon *= 2.0;
+    }
+    simple.swap(trial);
+
+    // Bisect between the last failing and the succeeding epsilon, in order to
+    // find the smallest epsilon still extracting the desired amount of corners.
+    if(lower > 0.0) {
+        while(epsilon - lower > SIMPLIFICATION_TOLERANCE) {
+            double middle = 0.5 * (lower + epsilon);
+            cv::approxPolyDP(hull, trial, middle, true);
+            iterations++;
+            if(trial.size() <= numPoints) {
+                epsilon = middle;
+                simple.swap(trial);
+            } else {
+                lower = middle;
+            }
+        }
     }
 
     // Store the epsilon that made it.
     if(eps)
-        *eps = epsilon;
+        *eps = static_cast<float>(epsilon);
 
-    return simple;
+    return iterations;
 }
 
 int QRDetector::countColorSwitch(const cv::Mat& image, const cv::Point& start, const cv::Point& end) const {
@@ -343,45 +1434,24 @@ uchar QRDetector::pickMeanPixel(const cv::Mat& image, const cv::Point& position,
         }
     }
 
-    if(avg / (((k+2)*(k+2))) > BINARY_THRESHOLD)
+    if(avg / ((2*k+1) * (2*k+1)) > config_.binaryThreshold)
         return 255;
 
     return 0;
 }
 
-cv::Point QRDetector::intersect(const cv::Point& a0, const cv::Point& a1, const cv::Point& c0, const cv::Point& c1) const {
-
-    if(c1.x == c0.x) {
-        if(a1.y != a0.y) {
-            double mA = (a1.y - a0.y) / static_cast<double>(a1.x - a0.x);
-            double bA = a0.y - (mA * a0.x);
-            double y = mA * c1.x + bA;
-            return cv::Point(c1.x, static_cast<int>(y));
-        } else {
-            return cv::Point(c1.x, a1.y);
-        }
-    } else if(a1.x == a0.x) {
-        if(c1.y != c0.y) {
-            double mC = (c1.y - c0.y) / static_cast<double>(c1.x - c0.x);
-            double bC = c0.y - (mC * c0.x);
-            double y = mC * a0.x + bC;
-            return cv::Point(a1.x, y);
-        } else {
-            return cv::Point(a1.x, c1.y);
-        }
-    } else {
-        // Calculate slopes.
-        double mA = (a1.y - a0.y) / static_cast<double>(a1.x - a0.x);
-        double mC = (c1.y - c0.y) / static_cast<double>(c1.x - c0.x);
+bool QRDetector::intersect(const cv::Point2f& a0, const cv::Point2f& a1, const cv::Point2f& c0, const cv::Point2f& c1, cv::Point2f& result) const {
 
-        // Calculate axis intersection.
-        double bA = a0.y - (mA * a0.x);
-        double bC = c0.y - (mC * c0.x);
+    // In homogeneous coordinates, the line through two points as well as the
+    // intersection of two lines are given by the cross product.
+    cv::Vec3d lineA = cv::Vec3d(a0.x, a0.y, 1.0).cross(cv::Vec3d(a1.x, a1.y, 1.0));
+    cv::Vec3d lineC = cv::Vec3d(c0.x, c0.y, 1.0).cross(cv::Vec3d(c1.x, c1.y, 1.0));
+    cv::Vec3d p = lineA.cross(lineC);
 
-        // Calculate line intersection point.
-        double x = (bC - bA) / (mA - mC);
-        double y = mC * x + bC;
+    // Parallel lines intersect at infinity, compared to the lengths of both lines.
+    if(std::abs(p[2]) <= 1e-9 * cv::norm(a1 - a0) * cv::norm(c1 - c0))
+        return false;
 
-        return cv::Point(static_cast<int>(x), static_cast<int>(y));
-    }
+    result = cv::Point2f(static_cast<float>(p[0] / p[2]), static_cast<float>(p[1] / p[2]));
+    return true;
 }
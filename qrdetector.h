@@ -3,37 +3,108 @@
 
 #include <opencv2/opencv.hpp>
 
+#include "bitmatrix.h"
+#include "finderscanner.h"
+#include "imageview.h"
+
+class QRDetectorContext;
+
+/**
+ * Locates QR codes and samples their modules. Detecting never modifies the detector,
+ * so a single one may be used by multiple threads at the same time, as long as each
+ * passes a QRDetectorContext of its own. Nothing is written to the console, failures
+ * are reported by empty results and QRDetectorContext::failure.
+ */
 class QRDetector {
 
-    // Canny Operator Thresholds.
+    // Canny Operator Thresholds, defaults of the Config.
     static constexpr double CANNY_LOWER_THRESHOLD = 50.0;
     static constexpr double CANNY_UPPER_THRESHOLD = 180.0;
 
-    // Median filter neighbourhood.
+    // Median filter neighbourhood, default of the Config.
     static constexpr int MEDIAN_BLUR_NEIGHBOURHOOD = 3;
 
-    // Binary imaging threshold.
+    // Binary imaging threshold, default of the Config.
     static constexpr int BINARY_THRESHOLD = 127;
 
-    // Epsilon used for contour simplification.
+    // Epsilon used for contour simplification, default of the Config.
     static constexpr double SIMPLFIICATION_START_EPSILON = 1.0;
 
-    // Min. ratio between bounding rect of a marker and the actual area.
+    // Precision, up to which the epsilon of the contour simplification is bisected.
+    static constexpr double SIMPLIFICATION_TOLERANCE = 0.25;
+
+    // Min. ratio between bounding rect of a marker and the actual area, default of the Config.
     static constexpr double MAX_AREA_THRESHOLD = 10.0;
 
+    // Sensitivity of the local thresholds, default of the Config.
+    static constexpr double ADAPTIVE_SENSITIVITY = 0.2;
+
+    // Window radius of the local thresholds in relation to the smaller image dimension, unless configured.
+    static constexpr int ADAPTIVE_RADIUS_DIVISOR = 16;
+    static constexpr int ADAPTIVE_MIN_RADIUS = 7;
+
+    // Max. cosine of the angle enclosed by the markers of a single code.
+    static constexpr double GROUPING_MAX_COSINE = 0.35;
+
+    // Max. ratio between the marker distances or the module sizes of a single code.
+    static constexpr double GROUPING_MAX_RATIO = 1.6;
+
+    // Range of the distance between the markers of a single code, in modules.
+    static constexpr double GROUPING_MIN_MODULES = 10.0;
+    static constexpr double GROUPING_MAX_MODULES = 200.0;
+
+    // Max. run of light modules between the markers of a single code.
+    static constexpr double GROUPING_MAX_LIGHT_RUN = 6.0;
+
+    // Min. dimension of the coarsest pyramid level.
+    static constexpr int PYRAMID_MIN_DIMENSION = 400;
+
+    // Images smaller than this get upscaled, in case nothing else worked.
+    static constexpr int UPSCALE_MIN_DIMENSION = 1500;
+
+    // Margin around a coarsely located code being refined, in modules.
+    static constexpr double REFINEMENT_MARGIN = 4.0;
+
+    // Min. module size in pixels, smaller modules are upscaled for refinement.
+    static constexpr double REFINEMENT_MIN_MODULE_SIZE = 3.0;
+
+    // Max. half size of the window used for refining the corners of a code.
+    static constexpr int CORNER_REFINEMENT_MAX_WINDOW = 5;
+
+    // Distance around the expected position of the alignment pattern being searched, in modules.
+    static constexpr double ALIGNMENT_SEARCH_RADIUS = 3.0;
+
+    // Min. modules out of the 5x5 alignment pattern, which need to match.
+    static constexpr int ALIGNMENT_MIN_SCORE = 22;
+
+    // Max. edge length of the thumbnail being prescreened, default of the Config.
+    static constexpr int PRESCREEN_DIMENSION = 480;
+
+    // Window of the local threshold binarizing the thumbnail, in thumbnail pixels.
+    static constexpr int PRESCREEN_BLOCK_SIZE = 31;
+
+    // Min. difference to the window's mean, below which a thumbnail pixel is dark.
+    static constexpr double PRESCREEN_CONTRAST = 35.0;
+
+    // Min. edge length of a tile, smaller images are not split.
+    static constexpr int TILING_MIN_SIZE = 512;
+
+    // Max. edge length of a marker being found in tiled mode, in relation to the smaller image dimension.
+    static constexpr double TILING_MAX_MARKER_FRACTION = 0.25;
+
+public:
+
     /**
      * This struct encodes the positions of the three markers of a QR code,
      * in relation to the image they are contained in.
      */
     struct QRCode {
-        cv::Point a, b, c, d;
+        cv::Point2f a, b, c, d;
         std::vector<std::vector<cv::Point>> patterns;
         float moduleSize;
     };
 
-public:
-
-    // Debug Details
+    // Debug Details. The requested images are kept by the context, see QRDetectorContext::debugImages.
     enum {
         DEBUG_NONE      = 0,
         DEBUG_BINARY    = 1 << 1,
@@ -42,27 +113,344 @@ public:
         DEBUG_ALIGNED   = 1 << 4,
     };
 
+    // Backends locating the markers.
+    enum Backend {
+        BACKEND_CONTOUR,  // Nested contours inside the edge map.
+        BACKEND_SCANLINE, // Runs of 1:1:3:1:1 along rows and columns.
+    };
+
+    // Binarization of the input image.
+    enum Binarization {
+        BINARIZATION_OTSU,    // Global threshold, framed by median filters.
+        BINARIZATION_SAUVOLA, // Local threshold from the mean and deviation of the surrounding window.
+        BINARIZATION_BRADLEY, // Local threshold from the mean of the surrounding window.
+    };
+
+    // Processing stages, being timed separately.
+    enum Stage {
+        STAGE_PREPROCESS, // Conversion into the binary image.
+        STAGE_CONTOURS,   // Edge map and contours, or scan lines.
+        STAGE_FILTER,     // Selecting and grouping the markers.
+        STAGE_EXTRACT,    // Locating the code's corners.
+        STAGE_ALIGN,      // Perspective transformation.
+        STAGE_NORMALIZE,  // Sampling the modules.
+        STAGE_COUNT,
+    };
+
+    // Reasons for not returning a code.
+    enum Failure {
+        FAILURE_NONE,       // A code has been found.
+        FAILURE_NO_MARKERS, // Less than three markers have been found.
+        FAILURE_NO_CODE,    // The markers do not form a code.
+        FAILURE_SAMPLING,   // The code could not be sampled.
+        FAILURE_PRESCREEN,  // The prescreen did not find enough finder-like runs.
+    };
+
+    /**
+     * Statistics gathered while detecting, if requested by QRDetectorContext::setStats.
+     * Counters and durations are summed up over all calls, until being reset, while
+     * scale and failure refer to the last call. Searching multiple scales results in
+     * multiple passes, which are all counted.
+     */
+    struct Stats {
+        double milliseconds[STAGE_COUNT]; // Time spent per stage.
+        int contours;           // Contours found inside the edge map.
+        int markers;            // Marker candidates, found by either backend.
+        int simplifyIterations; // Iterations needed to simplify contours.
+        int codes;              // Codes located.
+        double scale;           // Factor the image has been downscaled by for sampling the code.
+        Failure failure;        // Reason for not returning a code.
+
+        Stats();
+        void reset();
+
+        //! @brief Returns a short name of the given failure.
+        static const char* failureName(Failure failure);
+
+        //! @brief Returns a short name of the given stage.
+        static const char* stageName(Stage stage);
+    };
+
+    /**
+     * Parameters of the detector, which may be tuned at runtime. The defaults
+     * are the values the detector has been designed for.
+     */
+    struct Config {
+        double cannyLowerThreshold;        // Lower hysteresis threshold of the Canny operator.
+        double cannyUpperThreshold;        // Upper hysteresis threshold of the Canny operator.
+        int medianBlurNeighbourhood;       // Aperture of the median filters, odd and greater than 1.
+        int binaryThreshold;               // Mean value of a sampled neighbourhood, above which a module is light.
+        double simplificationStartEpsilon; // Epsilon the simplification of marker contours starts with.
+        double maxAreaThreshold;           // Max. deviation of the area ratios between the nested contours of a marker.
+        int adaptiveRadius;                // Window radius of the local thresholds, 0 to derive it from the image size.
+        double adaptiveSensitivity;        // Sensitivity k of the local thresholds, between 0 and 1.
+        int prescreenDimension;            // Max. edge length of the thumbnail being prescreened, in pixels.
+
+        Config();
+
+        //! @brief Checks whether all parameters are within their valid range.
+        bool valid() const;
+    };
+
+    QRDetector();
+
+    /**
+     * Replaces the parameters of the detector.
+     * @param config the new parameters
+     * @return false, if the parameters are invalid, the previous ones being kept
+     */
+    bool setConfig(const Config& config);
+
+    //! @brief Returns the parameters of the detector.
+    const Config& config() const { return config_; }
+
+    /**
+     * Enables the fused preprocessing kernel, which yields the very same binary
+     * image as the default chain of OpenCV filters, but in fewer passes.
+     * @param enabled whether to use the fused kernel
+     */
+    void setFusedPreprocessing(bool enabled);
+
+    //! @brief Selects the backend used for locating the markers.
+    void setBackend(Backend backend);
+
+    /**
+     * Selects how the input image is binarized. The local thresholds keep codes being lit
+     * unevenly, at the cost of not applying median filters. Their binary image is shared
+     * by locating and sampling, the code being warped from it in case of warp sampling.
+     * @param binarization the binarization
+     */
+    void setBinarization(Binarization binarization);
+
+    /**
+     * Enables sampling the modules directly from the binarized input image, by mapping
+     * each module's center through the code's homography. Otherwise, the whole code
+     * is warped and binarized again before being sampled, which is also the case if
+     * the aligned image is requested for debugging.
+     * @param enabled whether to sample the modules directly
+     */
+    void setDirectSampling(bool enabled);
+
+    /**
+     * Splits large images into a grid of overlapping tiles, whose marker contours are
+     * extracted in parallel. Tiles overlap by half the max. marker size, such that each
+     * marker is taken from the one tile containing its center in the non-overlapping
+     * part. Larger markers are lost, so the whole image is searched once more, if the
+     * tiles do not yield a code. Only applies to the contour backend, the edge map is not
+     * shown for debugging. Tiles run on OpenCV's thread pool, which needs to provide
+     * enough threads for them to run in parallel, see cv::setNumThreads.
+     * @param threads the number of threads, 1 disables tiling
+     */
+    void setThreads(int threads);
+
+    //! @brief Returns the number of threads used for tiling.
+    int threads() const { return threads_; }
+
+    /**
+     * Enables a cheap prescreen in front of detectQRCode(s) and detectQRCodeScaled. The image
+     * is subsampled into a thumbnail of Config::prescreenDimension pixels, which is binarized
+     * by a local threshold. Its rows and columns are scanned for runs in the ratio 1:1:3:1:1,
+     * images showing fewer runs are rejected right away. On a 480 pixel thumbnail, the codes
+     * of tests/images show 33 runs at least and frames without any code 5 at most, so about
+     * 12 runs are a reasonable choice. Modules smaller than two thumbnail pixels get lost.
+     * @param minRuns the min. number of runs, 0 disables the prescreen
+     */
+    void setPrescreen(int minRuns);
+
     /**
      * Finds QR code and normalize it.
      * @param input Image containing the one or more QR codes.
      * @param debug Optional debug flags
-     * @return a list holding the normalized QR Codes.
+     * @return the first normalized QR Code being found, or an empty matrix.
      */
     cv::Mat detectQRCode(const cv::Mat& image, int debug = DEBUG_NONE) const;
 
+    /**
+     * Finds QR code and normalize it, reusing the buffers of the given context.
+     * @param input Image containing the one or more QR codes.
+     * @param context Buffers kept between calls, the result is stored inside.
+     * @param debug Optional debug flags
+     * @return the first normalized QR Code being found, or an empty matrix.
+     *         It shares its data with the context, until the next call.
+     */
+    cv::Mat detectQRCode(const cv::Mat& image, QRDetectorContext& context, int debug = DEBUG_NONE) const;
+
+    /**
+     * Finds QR code and normalize it, processing a frame buffer in place.
+     * Planar YUV frames are processed by their Y plane, without any copy.
+     * @param view Frame containing the one or more QR codes.
+     * @param context Buffers kept between calls, the result is stored inside.
+     * @param debug Optional debug flags
+     * @return the first normalized QR Code being found, or an empty matrix.
+     *         It shares its data with the context, until the next call.
+     */
+    cv::Mat detectQRCode(const ImageView& view, QRDetectorContext& context, int debug = DEBUG_NONE) const;
+
+    /**
+     * Finds all QR codes inside the image and normalizes them.
+     * @param input Image containing the one or more QR codes.
+     * @param debug Optional debug flags
+     * @return a list holding the normalized QR Codes, best matches first.
+     */
+    std::vector<cv::Mat> detectQRCodes(const cv::Mat& image, int debug = DEBUG_NONE) const;
+
+    /**
+     * Finds all QR codes inside the image and normalizes them, reusing the buffers of the given context.
+     * @param input Image containing the one or more QR codes.
+     * @param context Buffers kept between calls, the result is stored inside.
+     * @param debug Optional debug flags
+     * @return a list holding the normalized QR Codes, best matches first. Located codes
+     *         which cannot be sampled are left out, as are their entries in the context.
+     *         It is owned by the context and valid until the next call.
+     */
+    const std::vector<cv::Mat>& detectQRCodes(const cv::Mat& image, QRDetectorContext& context, int debug = DEBUG_NONE) const;
+
+    /**
+     * Finds a QR code searching an image pyramid from coarse to fine.
+     * The first hit determines the region being refined in full resolution.
+     * @param input Image containing the QR code.
+     * @param debug Optional debug flags
+     * @return the normalized QR Code, or an empty matrix.
+     */
+    cv::Mat detectQRCodeScaled(const cv::Mat& image, int debug = DEBUG_NONE) const;
+
+    /**
+     * Finds a QR code searching an image pyramid from coarse to fine, reusing the buffers of the given context.
+     * @param input Image containing the QR code.
+     * @param context Buffers kept between calls, the result is stored inside.
+     * @param debug Optional debug flags
+     * @return the normalized QR Code, or an empty matrix. It shares its data
+     *         with the context, until the next call.
+     */
+    cv::Mat detectQRCodeScaled(const cv::Mat& image, QRDetectorContext& context, int debug = DEBUG_NONE) const;
+
+    /**
+     * Finds a QR code searching an image pyramid from coarse to fine, processing a frame buffer in place.
+     * Planar YUV frames are processed by their Y plane, without any copy.
+     * @param view Frame containing the QR code.
+     * @param context Buffers kept between calls, the result is stored inside.
+     * @param debug Optional debug flags
+     * @return the normalized QR Code, or an empty matrix. It shares its data
+     *         with the context, until the next call.
+     */
+    cv::Mat detectQRCodeScaled(const ImageView& view, QRDetectorContext& context, int debug = DEBUG_NONE) const;
+
+    /**
+     * Continues like detectQRCodeScaled, after locateQRCodes failed on the original image.
+     * Only the pyramid levels and the upscaled image are searched, the prescreen is skipped.
+     * @param input Image containing the QR code.
+     * @param numMarkers The number of markers, which have been found on the original image.
+     * @param context Buffers kept between calls, the result is stored inside.
+     * @param debug Optional debug flags
+     * @return the normalized QR Code, or an empty matrix. It shares its data
+     *         with the context, until the next call.
+     */
+    cv::Mat detectQRCodeRescaled(const cv::Mat& image, int numMarkers, QRDetectorContext& context, int debug = DEBUG_NONE) const;
+
+    /**
+     * Locates all QR codes inside the image, without normalizing them.
+     * @param input Image containing the one or more QR codes.
+     * @param debug Optional debug flags
+     * @param numMarkers Optionally receives the number of markers being found.
+     * @return a list holding the located QR Codes, best matches first.
+     */
+    std::vector<QRCode> locateQRCodes(const cv::Mat& image, int debug = DEBUG_NONE, int* numMarkers = nullptr) const;
+
+    /**
+     * Locates all QR codes inside the image, reusing the buffers of the given context.
+     * @param input Image containing the one or more QR codes.
+     * @param context Buffers kept between calls, the result is stored inside.
+     * @param debug Optional debug flags
+     * @param numMarkers Optionally receives the number of markers being found.
+     * @return a list holding the located QR Codes, best matches first. It is
+     *         owned by the context and valid until the next call.
+     */
+    const std::vector<QRCode>& locateQRCodes(const cv::Mat& image, QRDetectorContext& context, int debug = DEBUG_NONE, int* numMarkers = nullptr) const;
+
+    /**
+     * Aligns and normalizes a QR code, which has already been located.
+     * @param input Image containing the QR code.
+     * @param code The located QR code, its module size will be updated.
+     * @param debug Optional debug flags
+     * @return the normalized QR Code.
+     */
+    cv::Mat sampleQRCode(const cv::Mat& image, QRCode& code, int debug = DEBUG_NONE) const;
+
+    /**
+     * Aligns and normalizes a QR code, reusing the buffers of the given context.
+     * @param input Image containing the QR code.
+     * @param code The located QR code, its module size will be updated.
+     * @param context Buffers kept between calls, the result is stored inside.
+     * @param debug Optional debug flags
+     * @return the normalized QR Code. It shares its data with the context, until the next call.
+     */
+    cv::Mat sampleQRCode(const cv::Mat& image, QRCode& code, QRDetectorContext& context, int debug = DEBUG_NONE) const;
+
+    /**
+     * Aligns a located QR code and samples its modules right into a bit matrix.
+     * @param input Image containing the QR code.
+     * @param code The located QR code, its module size will be updated.
+     * @param context Buffers kept between calls.
+     * @param bits Receives one bit per module, set bits being dark.
+     * @return false, if the code could not be sampled.
+     */
+    bool sampleQRCode(const cv::Mat& image, QRCode& code, QRDetectorContext& context, BitMatrix& bits) const;
+
 private:
 
-    //! @brief Given the marker contours, this function will locate the QRCode.
-    QRCode extractQRCode(const std::vector<std::vector<cv::Point>>& patterns, cv::Mat& augmented) const;
+    //! @brief Converts the image into a filtered binary image, used for locating markers.
+    void binarize(const cv::Mat& image, cv::Mat& gray, QRDetectorContext& context) const;
+
+    //! @brief Checks whether the image may contain a code at all, returns false if not.
+    bool prescreen(const cv::Mat& image, QRDetectorContext& context) const;
+
+    //! @brief Searches the downscaled levels from coarse to fine, returns false if no code has been sampled on any of them.
+    bool searchPyramid(const cv::Mat& image, QRDetectorContext& context, int debug, cv::Mat& result) const;
+
+    //! @brief Searches the upscaled image, if promising by the number of markers found on the original one.
+    cv::Mat searchUpscaled(const cv::Mat& image, int numMarkers, QRDetectorContext& context, int debug) const;
+
+    //! @brief Detects the code inside the region of a coarsely located one, scale mapping coarse to image coordinates.
+    cv::Mat refineQRCode(const cv::Mat& image, const QRCode& coarse, double scale, QRDetectorContext& context, int debug) const;
+
+    //! @brief Finds the contours of all markers, by searching the contour hierarchy of the edge map.
+    void findMarkerContours(QRDetectorContext& context) const;
+
+    //! @brief Finds the contours of all markers like findMarkerContours, processing the tiles of the given grid in parallel.
+    void findMarkerContoursTiled(QRDetectorContext& context, int columns, int rows) const;
+
+    //! @brief Collects the indices of contours containing the nested contours of a marker.
+    void filterMarkerContours(const std::vector<std::vector<cv::Point>>& contours, const std::vector<cv::Vec4i>& hierarchy, std::vector<int>& positionCandidates) const;
+
+    //! @brief Assigns the marker candidates to the codes they belong to, using their geometric relation.
+    void groupPatterns(QRDetectorContext& context) const;
+
+    //! @brief Given the marker contours, this function will locate the QRCode, optionally drawing into augmented.
+    void extractQRCode(const std::vector<std::vector<cv::Point>>& patterns, QRCode& code, QRDetectorContext& context, cv::Mat* augmented) const;
+
+    //! @brief Samples a located code into result, binary being the binarized image or empty if not available.
+    void sampleQRCode(const cv::Mat& image, const cv::Mat& binary, QRCode& code, QRDetectorContext& context, cv::Mat& result, int debug) const;
+
+    //! @brief Implements sampleQRCode, which additionally records its outcome. If bits is given, the modules are stored there instead.
+    void sampleLocatedCode(const cv::Mat& image, const cv::Mat& binary, QRCode& code, QRDetectorContext& context, cv::Mat& result, int debug, BitMatrix* bits = nullptr) const;
+
+    //! @brief Samples each module by mapping its center into the binary image, whose origin is located at offset. If bits is given, the modules are stored there instead of result.
+    void sampleGrid(const cv::Mat& binary, const cv::Point& offset, QRCode& code, cv::Mat& result, QRDetectorContext& context, BitMatrix* bits = nullptr) const;
+
+    //! @brief Moves the estimated corner d, such that the bottom right alignment pattern is hit. Returns false if not found.
+    bool refineAlignment(const cv::Mat& binary, const cv::Point& offset, QRCode& code, QRDetectorContext& context) const;
+
+    //! @brief Determines the module size of the code, once being transformed by warpMat.
+    void estimateModuleSize(QRCode& code, const cv::Mat& warpMat, QRDetectorContext& context) const;
 
     //! @brief Transforms the QR-Code onto the xy-plane.
-    cv::Mat alignQRCode(const cv::Mat& image, QRCode& code) const;
+    void alignQRCode(const cv::Mat& image, QRCode& code, cv::Mat& result, QRDetectorContext& context) const;
 
     //! @brief Normalizes the given QR-Code, including binarization and shrinking to min. size.
-    cv::Mat normalizeQRCode(const cv::Mat& image, const QRCode& code) const;
+    void normalizeQRCode(const cv::Mat& image, const QRCode& code, cv::Mat& result, QRDetectorContext& context) const;
 
-    //! @brief Simplifies a given contour to ultimately consisting out of max. the specified amount of points.
-    std::vector<cv::Point> simplifyContour(const std::vector<cv::Point>& contour, int numPoints, float* const eps = nullptr) const;
+    //! @brief Simplifies a given contour to ultimately consisting out of max. the specified amount of points, returns the iterations needed.
+    int simplifyContour(const std::vector<cv::Point>& contour, int numPoints, std::vector<cv::Point>& simple, QRDetectorContext& context, float* const eps = nullptr) const;
 
     //! @brief Counts the number of switches in color, when moving across the image along a line given by start and end.
     int countColorSwitch(const cv::Mat& image, const cv::Point& start, const cv::Point& end) const;
@@ -70,8 +458,133 @@ private:
     //! @brief Picks a pixel out of image taking a neighbourhood of k into account.
     uchar pickMeanPixel(const cv::Mat& image, const cv::Point& position, int k) const;
 
-    //! @brief Calculates the intersection point betwee, two lines defined by a0a1 and c0c1, respectively.
-    cv::Point intersect(const cv::Point& a0, const cv::Point& a1, const cv::Point& c0, const cv::Point& c1) const;
+    //! @brief Calculates the intersection point between two lines defined by a0a1 and c0c1, respectively. Returns false if they are parallel.
+    bool intersect(const cv::Point2f& a0, const cv::Point2f& a1, const cv::Point2f& c0, const cv::Point2f& c1, cv::Point2f& result) const;
+
+    Config config_;
+    bool fusedPreprocessing_;
+    bool directSampling_;
+    Backend backend_;
+    Binarization binarization_;
+    int threads_;
+    int prescreenMinRuns_;
+};
+
+/**
+ * Holds the buffers used while detecting QR codes. Passing the same context to
+ * subsequent calls of a detector reuses them, such that processing a stream of
+ * similar frames does not allocate any memory on its own once the buffers are
+ * warmed up. Results returned by those calls are stored inside the context as
+ * well and get overwritten by the next call.
+ * A context must not be shared between threads running at the same time.
+ */
+class QRDetectorContext {
+    friend class QRDetector;
+
+public:
+
+    QRDetectorContext();
+
+    /**
+     * Gathers statistics of the following calls using this context.
+     * @param stats receives the statistics, or nullptr to disable gathering them
+     */
+    void setStats(QRDetector::Stats* stats);
+
+    //! @brief Returns the reason, why the last call using this context did not return a code.
+    QRDetector::Failure failure() const { return lastFailure; }
+
+    /**
+     * Returns the located code of the first result returned by the last detecting call,
+     * its corners being mapped into the image passed to that call.
+     * @return the code, or nullptr if no code has been returned
+     */
+    const QRDetector::QRCode* code() const { return hasCode ? &resultCode : nullptr; }
+
+    // An intermediate image along with its name.
+    typedef std::pair<const char*, cv::Mat> DebugImage;
+
+    /**
+     * Returns the intermediate images requested by the debug flags, the latest one of
+     * each name being kept. They share their data with the context, so they need to be
+     * copied or shown before the next call.
+     * @return the images, in the order their names have been requested first
+     */
+    const std::vector<DebugImage>& debugImages() const { return debugOutput; }
+
+private:
+
+    //! @brief Records the outcome of a call, into the statistics as well if enabled.
+    void setFailure(QRDetector::Failure failure);
+
+    //! @brief Keeps an intermediate image, replacing the one of the same name.
+    void setDebugImage(const char* name, const cv::Mat& image);
+
+    //! @brief Records the code of the returned result, mapping it into the input image by scale and offset. Passing nullptr clears it.
+    void setCode(const QRDetector::QRCode* code, double scale = 1.0, const cv::Point2f& offset = cv::Point2f());
+
+    QRDetector::Stats* stats;
+    QRDetector::Failure lastFailure;
+    QRDetector::QRCode resultCode;
+    bool hasCode;
+    std::vector<DebugImage> debugOutput;
+
+    // A tile of the image, searched for markers on its own.
+    struct Tile {
+        cv::Rect roi;  // Region being searched, including the overlap.
+        cv::Rect core; // Markers are only taken, if their center is inside.
+        cv::Mat edgeMap;
+        std::vector<std::vector<cv::Point>> contours;
+        std::vector<cv::Vec4i> hierarchy;
+        std::vector<int> positionCandidates;
+    };
+
+    // A triple of marker candidates, rated by how good they form a code.
+    struct Triple {
+        int markers[3];
+        double score;
+    };
+
+    // Preprocessing.
+    cv::Mat luma, gray, edgeMap, augmented;
+    cv::Mat thumbnail, binaryThumbnail;
+    std::vector<uchar> binarizationBuffer;
+
+    // Marker search.
+    std::vector<std::vector<cv::Point>> contours, markers, candidates;
+    std::vector<cv::Vec4i> hierarchy;
+    std::vector<int> positionCandidates;
+    std::vector<Tile> tiles;
+    FinderScanner scanner;
+    std::vector<FinderScanner::Center> scannerCenters;
+
+    // Grouping.
+    std::vector<cv::Point2f> centers;
+    std::vector<double> moduleSizes;
+    std::vector<Triple> triples;
+    std::vector<char> used;
+    std::vector<cv::Vec3i> groups;
+
+    // Simplification.
+    std::vector<cv::Point> convexHull, simplified;
+
+    // Extraction.
+    std::vector<std::vector<cv::Point>> patterns;
+    std::vector<cv::Point> corners, hull;
+    std::vector<cv::Point2f> refinedCorners;
+    std::vector<QRDetector::QRCode> codes;
+
+    // Alignment and normalization.
+    std::vector<cv::Point2f> transformed;
+    cv::Mat aligned, binaryAligned;
+    std::vector<int> sampleCenters;
+    std::vector<cv::Mat> results;
+
+    // Pyramid search.
+    std::vector<cv::Mat> pyramid;
+    std::vector<cv::Point> scaledCorners;
+    std::vector<QRDetector::QRCode> coarse;
+    cv::Mat upscaled;
 };
 
 
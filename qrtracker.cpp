@@ -0,0 +1,145 @@
+#include "qrtracker.h"
+
+/**
+ * Helper function, calculating the area of the quadrilateral spanned by a code.
+ * @param code the code
+ * @return the area, being negative for clockwise corners
+ */
+static double codeArea(const QRDetector::QRCode& code) {
+    // Shoelace formula, which does not need the corners to be copied into a contour.
+    const cv::Point2f quad[] = {code.a, code.b, code.c, code.d};
+    double area = 0.0;
+    for(int i = 0; i < 4; i++)
+        area += static_cast<double>(quad[i].x) * quad[(i + 1) % 4].y - static_cast<double>(quad[(i + 1) % 4].x) * quad[i].y;
+    return area / 2.0;
+}
+
+QRTracker::QRTracker(const QRDetector& detector)
+    : detector_(detector)
+    , size_(0)
+    , framesTracked_(0)
+    , tracking_(false)
+    , lastFrameTracked_(false)
+{
+}
+
+cv::Mat QRTracker::track(const cv::Mat& frame, int debug) {
+    // Converted into a member, while a grayscale frame is only referenced.
+    cv::Mat gray = frame;
+    if(frame.channels() != 1) {
+        cv::cvtColor(frame, gray_, CV_RGB2GRAY);
+        gray = gray_;
+    }
+
+    lastFrameTracked_ = false;
+    if(tracking_ && framesTracked_ < KEYFRAME_INTERVAL && follow(gray)) {
+        cv::Mat result = detector_.sampleQRCode(frame, code_, context_, debug);
+
+        // The code's version can not change while being tracked.
+        if(result.rows == size_) {
+            gray.copyTo(previous_);
+            framesTracked_++;
+            lastFrameTracked_ = true;
+            return result;
+        }
+    }
+
+    // Tracking is not confident, so fall back to full detection.
+    cv::Mat result = detect(frame, debug);
+    if(tracking_)
+        gray.copyTo(previous_);
+
+    return result;
+}
+
+bool QRTracker::isTracking() const {
+    return tracking_;
+}
+
+const QRDetector::QRCode& QRTracker::code() const {
+    return code_;
+}
+
+bool QRTracker::lastFrameTracked() const {
+    return lastFrameTracked_;
+}
+
+void QRTracker::reset() {
+    tracking_ = false;
+    framesTracked_ = 0;
+    size_ = 0;
+}
+
+cv::Mat QRTracker::detect(const cv::Mat& frame, int debug) {
+    reset();
+
+    const std::vector<QRDetector::QRCode>& codes = detector_.locateQRCodes(frame, context_, debug);
+    if(codes.empty())
+        return cv::Mat();
+
+    code_ = codes.front();
+    cv::Mat result = detector_.sampleQRCode(frame, code_, context_, debug);
+    size_ = result.rows;
+    tracking_ = true;
+
+    return result;
+}
+
+bool QRTracker::follow(const cv::Mat& gray) {
+
+    // The marker vertices provide the most distinct corners to be tracked.
+    prevPoints_.clear();
+    for(const std::vector<cv::Point>& pattern : code_.patterns)
+        for(const cv::Point& p : pattern)
+            prevPoints_.push_back(p);
+
+    cv::calcOpticalFlowPyrLK(previous_, gray, prevPoints_, nextPoints_, status_, error_,
+                             cv::Size(FLOW_WINDOW_SIZE, FLOW_WINDOW_SIZE), FLOW_PYRAMID_LEVELS);
+
+    src_.clear();
+    dst_.clear();
+    for(size_t i = 0; i < status_.size(); i++) {
+        if(status_[i]) {
+            src_.push_back(prevPoints_[i]);
+            dst_.push_back(nextPoints_[i]);
+        }
+    }
+    if(src_.size() < MIN_TRACKED_POINTS)
+        return false;
+
+    // All vertices lie on a plane, so their motion is described by a homography.
+    cv::Mat homography = cv::findHomography(src_, dst_, cv::RANSAC, MAX_REPROJECTION_ERROR, inliers_);
+    if(homography.empty() || cv::countNonZero(inliers_) < MIN_TRACKED_POINTS)
+        return false;
+
+    // Move the code along. The assignment reuses the vertices' memory of the last frame.
+    moved_ = code_;
+    corners_.assign({code_.a, code_.b, code_.c, code_.d});
+    cv::perspectiveTransform(corners_, corners_, homography);
+    moved_.a = corners_[0];
+    moved_.b = corners_[1];
+    moved_.c = corners_[2];
+    moved_.d = corners_[3];
+    for(std::vector<cv::Point>& pattern : moved_.patterns) {
+        vertices_.assign(pattern.begin(), pattern.end());
+        cv::perspectiveTransform(vertices_, vertices_, homography);
+        for(size_t i = 0; i < pattern.size(); i++)
+            pattern[i] = vertices_[i];
+    }
+
+    // Reject degenerated or suddenly changing geometry.
+    double before = std::abs(codeArea(code_)), after = std::abs(codeArea(moved_));
+    quad_.assign({moved_.a, moved_.b, moved_.c, moved_.d});
+    if(before <= 0.0 || after <= 0.0 || !cv::isContourConvex(quad_) ||
+       std::max(before, after) / std::min(before, after) > MAX_AREA_CHANGE)
+        return false;
+
+    const cv::Rect bounds(0, 0, gray.cols, gray.rows);
+    for(const cv::Point& p : quad_) {
+        if(!bounds.contains(p))
+            return false;
+    }
+
+    std::swap(code_, moved_);
+    return true;
+}
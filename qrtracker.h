@@ -0,0 +1,86 @@
+#ifndef QR_CODE_QRTRACKER_H
+#define QR_CODE_QRTRACKER_H
+
+#include <opencv2/opencv.hpp>
+
+#include "qrdetector.h"
+
+/**
+ * Follows a single QR code through a sequence of frames.
+ * Once a code has been detected, the vertices of its markers are tracked
+ * by optical flow, such that the expensive full frame detection only needs
+ * to run again, when tracking becomes unreliable.
+ */
+class QRTracker {
+
+    // Min. number of marker vertices, which need to be tracked successfully.
+    static constexpr int MIN_TRACKED_POINTS = 8;
+
+    // Max. reprojection error of a tracked vertex in pixels.
+    static constexpr double MAX_REPROJECTION_ERROR = 3.0;
+
+    // Max. change of the code's area between two frames.
+    static constexpr double MAX_AREA_CHANGE = 1.5;
+
+    // Force a full detection after this amount of tracked frames, to avoid drift.
+    static constexpr int KEYFRAME_INTERVAL = 60;
+
+    // Optical flow parameters.
+    static constexpr int FLOW_WINDOW_SIZE = 21;
+    static constexpr int FLOW_PYRAMID_LEVELS = 3;
+
+public:
+
+    explicit QRTracker(const QRDetector& detector = QRDetector());
+
+    /**
+     * Processes the next frame, either by tracking or detecting the code.
+     * @param frame the current frame
+     * @param debug Optional debug flags
+     * @return the normalized QR Code, or an empty matrix. Its data is reused by the next frame.
+     */
+    cv::Mat track(const cv::Mat& frame, int debug = QRDetector::DEBUG_NONE);
+
+    //! @brief Whether a code is currently being tracked.
+    bool isTracking() const;
+
+    //! @brief The code being tracked, only valid while tracking.
+    const QRDetector::QRCode& code() const;
+
+    //! @brief Whether the result of the last frame has been obtained by tracking.
+    bool lastFrameTracked() const;
+
+    //! @brief The context of the last frame's detection, holding its debug images.
+    const QRDetectorContext& context() const { return context_; }
+
+    //! @brief Drops the current code, the next frame will run a full detection.
+    void reset();
+
+private:
+
+    //! @brief Runs a full detection on the given frame.
+    cv::Mat detect(const cv::Mat& frame, int debug);
+
+    //! @brief Moves the code from the previous to the current frame, returns false if not confident.
+    bool follow(const cv::Mat& gray);
+
+    QRDetector detector_;
+    QRDetectorContext context_;
+    QRDetector::QRCode code_;
+    cv::Mat previous_;
+
+    // Working memory of each frame, being reused such that tracking does not allocate.
+    cv::Mat gray_;
+    QRDetector::QRCode moved_;
+    std::vector<cv::Point2f> prevPoints_, nextPoints_, src_, dst_, corners_, vertices_;
+    std::vector<cv::Point> quad_;
+    std::vector<uchar> status_, inliers_;
+    std::vector<float> error_;
+    int size_;
+    int framesTracked_;
+    bool tracking_;
+    bool lastFrameTracked_;
+};
+
+
+#endif //QR_CODE_QRTRACKER_H
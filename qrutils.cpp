@@ -0,0 +1,178 @@
+#include "qrutils.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+cv::Mat detectWithScaling(const QRDetector& detector, const cv::Mat& image, bool tryScaling) {
+
+    // Sometimes rescaling the image improves edge-detection and therefore QR-Code detection.
+    if(tryScaling)
+        return detector.detectQRCodeScaled(image);
+
+    return detector.detectQRCode(image);
+}
+
+cv::Mat detectWithScaling(const QRDetector& detector, const cv::Mat& image, bool tryScaling, QRDetectorContext& context) {
+
+    // Sometimes rescaling the image improves edge-detection and therefore QR-Code detection.
+    if(tryScaling)
+        return detector.detectQRCodeScaled(image, context);
+
+    return detector.detectQRCode(image, context);
+}
+
+int compareWithReference(const cv::Mat& qr, const cv::Mat& reference, cv::Mat& diff) {
+    BitMatrix qrBits, referenceBits;
+    if(reference.cols != qr.cols || reference.rows != qr.rows || reference.type() != qr.type() ||
+       !qrBits.fromMat(qr) || !referenceBits.fromMat(reference)) {
+        diff = cv::Mat::zeros(1, 1, CV_8UC1);
+        diff.at<uchar>(0, 0) = 255;
+        return -1;
+    }
+
+    // Compare whole words, only visiting the modules of words that differ.
+    const int errors = qrBits.countDifferences(referenceBits);
+    diff = cv::Mat::zeros(reference.rows, reference.cols, CV_8UC1);
+    for(int r = 0; errors && r < qrBits.size(); r++) {
+        const uint64_t* a = qrBits.row(r);
+        const uint64_t* b = referenceBits.row(r);
+        uchar* row = diff.ptr(r);
+        for(int w = 0; w < qrBits.wordsPerRow(); w++) {
+            const uint64_t x = a[w] ^ b[w];
+            for(int bit = 0; bit < 64 && (x >> bit); bit++) {
+                if((x >> bit) & 1)
+                    row[w * 64 + bit] = 255;
+            }
+        }
+    }
+
+    return errors;
+}
+
+bool writeCompact(const std::string& filename, const BitMatrix& bits, const QRDetector::QRCode* code) {
+    std::ofstream stream(filename.c_str(), std::ios::binary);
+    if(!code)
+        return bits.write(stream);
+
+    const cv::Point2f corners[] = {code->a, code->b, code->c, code->d};
+    return bits.write(stream, corners);
+}
+
+std::string fileStem(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    return name.substr(0, name.rfind('.'));
+}
+
+std::string referenceFile(const std::string& input, const std::string& referenceDir) {
+    std::string stem = fileStem(input);
+    return referenceDir + "/" + stem.substr(0, stem.rfind('_')) + ".png";
+}
+
+std::string quoteJson(const std::string& value) {
+    std::string result = "\"";
+    for(char c : value) {
+        if(c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if(static_cast<unsigned char>(c) < 0x20 || static_cast<unsigned char>(c) > 0x7e) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+            result += escaped;
+        } else {
+            result += c;
+        }
+    }
+    return result + "\"";
+}
+
+bool writeUncompressed(const std::string& filename, const cv::Mat& image) {
+
+    // Deactivate compression.
+    std::vector<int> params;
+    params.push_back(CV_IMWRITE_PNG_COMPRESSION);
+    params.push_back(0);
+
+    return cv::imwrite(filename, image, params);
+}
+
+bool parseDetectorOptions(int& argc, char** argv, QRDetector& detector) {
+    QRDetector::Config config = detector.config();
+    int count = 1;
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        char end;
+        if(arg.compare(0, 8, "--canny=") == 0) {
+            if(std::sscanf(arg.c_str() + 8, "%lf,%lf%c", &config.cannyLowerThreshold, &config.cannyUpperThreshold, &end) != 2)
+                return false;
+        } else if(arg.compare(0, 9, "--median=") == 0) {
+            if(std::sscanf(arg.c_str() + 9, "%d%c", &config.medianBlurNeighbourhood, &end) != 1)
+                return false;
+        } else if(arg.compare(0, 19, "--sample-threshold=") == 0) {
+            if(std::sscanf(arg.c_str() + 19, "%d%c", &config.binaryThreshold, &end) != 1)
+                return false;
+        } else if(arg.compare(0, 10, "--epsilon=") == 0) {
+            if(std::sscanf(arg.c_str() + 10, "%lf%c", &config.simplificationStartEpsilon, &end) != 1)
+                return false;
+        } else if(arg.compare(0, 11, "--max-area=") == 0) {
+            if(std::sscanf(arg.c_str() + 11, "%lf%c", &config.maxAreaThreshold, &end) != 1)
+                return false;
+        } else if(arg.compare(0, 11, "--adaptive=") == 0) {
+            if(std::sscanf(arg.c_str() + 11, "%d,%lf%c", &config.adaptiveRadius, &config.adaptiveSensitivity, &end) != 2)
+                return false;
+        } else if(arg.compare(0, 17, "--prescreen-size=") == 0) {
+            if(std::sscanf(arg.c_str() + 17, "%d%c", &config.prescreenDimension, &end) != 1)
+                return false;
+        } else if(arg == "--binarization=otsu")
+            detector.setBinarization(QRDetector::BINARIZATION_OTSU);
+        else if(arg == "--binarization=sauvola")
+            detector.setBinarization(QRDetector::BINARIZATION_SAUVOLA);
+        else if(arg == "--binarization=bradley")
+            detector.setBinarization(QRDetector::BINARIZATION_BRADLEY);
+        else if(arg.compare(0, 15, "--binarization=") == 0)
+            return false;
+        else if(arg == "--backend=contour")
+            detector.setBackend(QRDetector::BACKEND_CONTOUR);
+        else if(arg == "--backend=scanline")
+            detector.setBackend(QRDetector::BACKEND_SCANLINE);
+        else if(arg.compare(0, 10, "--backend=") == 0)
+            return false;
+        else if(arg == "--sampling=direct")
+            detector.setDirectSampling(true);
+        else if(arg == "--sampling=warp")
+            detector.setDirectSampling(false);
+        else if(arg.compare(0, 11, "--sampling=") == 0)
+            return false;
+        else if(arg == "--preprocessing=fused")
+            detector.setFusedPreprocessing(true);
+        else if(arg == "--preprocessing=opencv")
+            detector.setFusedPreprocessing(false);
+        else if(arg.compare(0, 16, "--preprocessing=") == 0)
+            return false;
+        else if(arg.compare(0, 10, "--threads=") == 0 && std::atoi(arg.c_str() + 10) > 0)
+            detector.setThreads(std::atoi(arg.c_str() + 10));
+        else if(arg.compare(0, 10, "--threads=") == 0)
+            return false;
+        else if(arg.compare(0, 12, "--prescreen=") == 0 && arg.size() > 12 && std::isdigit(static_cast<unsigned char>(arg[12])))
+            detector.setPrescreen(std::atoi(arg.c_str() + 12));
+        else if(arg.compare(0, 12, "--prescreen=") == 0)
+            return false;
+        else
+            argv[count++] = argv[i];
+    }
+    argc = count;
+    return detector.setConfig(config);
+}
+
+std::string formatDetectorConfig(const QRDetector::Config& config) {
+    std::ostringstream options;
+    options << "--canny=" << config.cannyLowerThreshold << "," << config.cannyUpperThreshold
+            << " --median=" << config.medianBlurNeighbourhood
+            << " --sample-threshold=" << config.binaryThreshold
+            << " --epsilon=" << config.simplificationStartEpsilon
+            << " --max-area=" << config.maxAreaThreshold
+            << " --adaptive=" << config.adaptiveRadius << "," << config.adaptiveSensitivity
+            << " --prescreen-size=" << config.prescreenDimension;
+    return options.str();
+}
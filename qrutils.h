@@ -0,0 +1,84 @@
+#ifndef QR_CODE_QRUTILS_H
+#define QR_CODE_QRUTILS_H
+
+#include <opencv2/opencv.hpp>
+
+#include "qrdetector.h"
+
+/**
+ * Runs the detector on the given image. If <p>tryScaling</p> is set,
+ * the image is searched on multiple scales.
+ * @param detector the detector to be used
+ * @param image the input image
+ * @param tryScaling whether to search multiple scales
+ * @return the normalized QR code, or an empty matrix
+ */
+cv::Mat detectWithScaling(const QRDetector& detector, const cv::Mat& image, bool tryScaling);
+
+/**
+ * Same as above, but reuses the buffers of the given context. The result
+ * shares its data with the context, until the context is used again.
+ */
+cv::Mat detectWithScaling(const QRDetector& detector, const cv::Mat& image, bool tryScaling, QRDetectorContext& context);
+
+/**
+ * Compares a normalized QR code with its reference, counting differing modules on bit-packed words.
+ * @param qr the normalized QR code
+ * @param reference the reference image
+ * @param diff receives an image marking each differing module
+ * @return the number of differing modules, or -1 if size or type do not match
+ */
+int compareWithReference(const cv::Mat& qr, const cv::Mat& reference, cv::Mat& diff);
+
+/**
+ * Applies the detector options given on the command line and removes them from the arguments.
+ * Supported options: --backend=contour|scanline, --sampling=direct|warp, --preprocessing=fused|opencv, --binarization=otsu|sauvola|bradley,
+ * --threads=<n>, --prescreen=<min. runs> as well as the parameters of QRDetector::Config: --canny=<lower>,<upper>, --median=<n>,
+ * --sample-threshold=<t>, --epsilon=<e>, --max-area=<r>, --adaptive=<radius>,<k>, --prescreen-size=<px>
+ * @param argc the number of arguments, updated to the remaining ones
+ * @param argv the arguments
+ * @param detector the detector to be configured
+ * @return false, if an option is invalid
+ */
+bool parseDetectorOptions(int& argc, char** argv, QRDetector& detector);
+
+//! @brief Formats the parameters as options being understood by parseDetectorOptions.
+std::string formatDetectorConfig(const QRDetector::Config& config);
+
+/**
+ * Helper function, extracting the file name without directory and extension.
+ * @param path the path to the file
+ * @return the file's stem
+ */
+std::string fileStem(const std::string& path);
+
+/**
+ * Determines the reference of an image, being <name>.png for an image named <name>_<suffix>.<ext>.
+ * @param input the image file
+ * @param referenceDir the directory holding the references
+ * @return the path to the reference
+ */
+std::string referenceFile(const std::string& input, const std::string& referenceDir);
+
+/**
+ * Quotes a string to be written into JSON, escaping quotes, backslashes as well as
+ * control and non-ASCII bytes. The latter are taken as Latin-1, QR's default encoding.
+ * @param value the string
+ * @return the quoted and escaped string
+ */
+std::string quoteJson(const std::string& value);
+
+//! @brief Writes an image as uncompressed PNG.
+bool writeUncompressed(const std::string& filename, const cv::Mat& image);
+
+/**
+ * Writes a bit-packed code as compact record, see BitMatrix.
+ * @param filename the file to write
+ * @param bits the modules of the code
+ * @param code optional located code, whose corners are stored as well
+ * @return false, if writing failed
+ */
+bool writeCompact(const std::string& filename, const BitMatrix& bits, const QRDetector::QRCode* code = nullptr);
+
+
+#endif //QR_CODE_QRUTILS_H
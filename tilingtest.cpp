@@ -0,0 +1,81 @@
+#include <opencv2/opencv.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "batchprocessor.h"
+#include "qrdetector.h"
+
+//////////////////////////////////////////////////////
+/// Constants definition section
+///
+static const char* DEFAULT_IMAGES = "tests/images";
+static const int TILING_THREADS = 4;
+static const float MAX_CORNER_DISTANCE = 1.0f;
+//////////////////////////////////////////////////////
+
+namespace {
+
+    //! @brief Checks whether the corners of two located codes coincide.
+    bool sameCorners(const QRDetector::QRCode& a, const QRDetector::QRCode& b) {
+        const cv::Point2f first[] = {a.a, a.b, a.c, a.d};
+        const cv::Point2f second[] = {b.a, b.b, b.c, b.d};
+        for(int i = 0; i < 4; i++) {
+            if(cv::norm(first[i] - second[i]) > MAX_CORNER_DISTANCE)
+                return false;
+        }
+        return true;
+    }
+}
+
+/**
+ * Regression check of the tiled contour extraction, locating the codes of each image
+ * of tests/images once on the whole image and once split into tiles. Both have to
+ * find the same number of markers and the same codes. Run from the source directory,
+ * or pass the image directory.
+ */
+int main(int argc, char** argv) {
+    std::string imageDir = (argc > 1) ? argv[1] : DEFAULT_IMAGES;
+
+    // Tiles are searched in parallel, as far as OpenCV's thread pool allows.
+    QRDetector whole, tiled;
+    tiled.setThreads(TILING_THREADS);
+    QRDetectorContext wholeContext, tiledContext;
+
+    int failures = 0;
+    const std::vector<std::string> inputs = BatchProcessor::collectInputs(imageDir);
+    for(const std::string& input : inputs) {
+        cv::Mat image = cv::imread(input);
+        if(image.empty()) {
+            std::cout << "FAILED " << input << ": cannot load the image" << std::endl;
+            failures++;
+            continue;
+        }
+
+        int wholeMarkers = 0, tiledMarkers = 0;
+        const std::vector<QRDetector::QRCode>& expected = whole.locateQRCodes(image, wholeContext, QRDetector::DEBUG_NONE, &wholeMarkers);
+        const std::vector<QRDetector::QRCode>& codes = tiled.locateQRCodes(image, tiledContext, QRDetector::DEBUG_NONE, &tiledMarkers);
+        std::cout << input << ": " << wholeMarkers << " markers, " << expected.size() << " codes on the whole image, "
+                  << tiledMarkers << " markers, " << codes.size() << " codes on tiles" << std::endl;
+
+        if(wholeMarkers != tiledMarkers || expected.size() != codes.size()) {
+            std::cout << "FAILED " << input << ": tiles differ from the whole image" << std::endl;
+            failures++;
+            continue;
+        }
+        for(size_t i = 0; i < codes.size(); i++) {
+            if(!sameCorners(expected[i], codes[i])) {
+                std::cout << "FAILED " << input << ": corners of code " << i << " differ" << std::endl;
+                failures++;
+            }
+        }
+    }
+    if(inputs.empty()) {
+        std::cout << "FAILED " << imageDir << ": no images found" << std::endl;
+        failures++;
+    }
+
+    std::cout << (failures ? "Tiling regression failed." : "Tiling regression passed.") << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}